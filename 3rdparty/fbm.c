@@ -21,33 +21,62 @@
 #pragma warning(disable:4244)
 #endif
 
-/* Definitions used by the noise2() functions */
+/* The batch functions have SSE4.1 and AVX2 kernels, picked at run time
+   from what the CPU supports. */
+#if defined(__x86_64__) || defined(_M_X64)
+#define FBM_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FBM_TARGET_SSE41
+#define FBM_TARGET_AVX2
+#else
+#define FBM_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define FBM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
-//#define B 0x100
-//#define BM 0xff
-#define B 0x20
-#define BM 0x1f
+/* Definitions used by the noise2() functions */
 
 #define N 0x1000
 #define NP 12   /* 2^N */
 #define NM 0xfff
 
-static int   p[B + B + 2];
-static float g3[B + B + 2][3];
-static float g2[B + B + 2][2];
-static float g1[B + B + 2];
+/* Lattice size of the context behind the non-reentrant noise3() interface.
+   It used to be the compile-time B, with BM == B - 1 as the index mask. */
+#define DEFAULT_SIZE 0x20
+
+struct NoiseContext {
+    unsigned int seed;
+    int size;           /* B, a power of two */
+    int mask;           /* BM */
+    int *p;             /* [B + B + 2] */
+    float (*g3)[3];     /* [B + B + 2] */
+};
+
+/* Additive feedback generator, the same as glibc's rand() (TYPE_3), so that a
+   context seeded with 1 reproduces the tables earlier versions built from
+   the unseeded rand() on glibc. Unlike rand() it keeps its state locally. */
+typedef struct {
+    unsigned int r[34];
+    int i;
+} NoiseRandom;
+
+static void random_seed(NoiseRandom *rng, unsigned int seed);
+static int random_next(NoiseRandom *rng);
+
+static NoiseContext *default_context = 0;
+static unsigned int default_seed = 1;
 static int   start = 1;
 
-static void init(void);
-
 #define s_curve(t) ( t * t * (3. - 2. * t) )
 
 #define lerp(t, a, b) ( a + t * (b - a) )
 
 #define setup(i,b0,b1,r0,r1)\
 	t = vec[i] + N;\
-	b0 = ((int)t) & BM;\
-	b1 = (b0+1) & BM;\
+	b0 = ((int)t) & ctx->mask;\
+	b1 = (b0+1) & ctx->mask;\
 	r0 = t - (int)t;\
 	r1 = r0 - 1.;
 #define at3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
@@ -66,7 +95,7 @@ double fBm( Vector point, double H, double lacunarity, double octaves,
     /* precompute and store spectral weights */
     if ( init ) {
 	start = 1;
-	srand( time(0) );
+	default_seed = time(0);
 	/* seize required memory for exponent_array */
 	frequency = 1.0;
 	for (i=0; i<=octaves; i++) {
@@ -102,17 +131,97 @@ double fBm( Vector point, double H, double lacunarity, double octaves,
 } /* fBm() */
 
 
+/* Reentrant fBm(): the spectral weights are computed per call instead of
+   being kept from an earlier call with 'init' set. Gives the same result as
+   fBm() with the same parameters on the same context. */
+double fBm_r( const NoiseContext *ctx, Vector point, double H, double lacunarity,
+	      double octaves )
+{
+    double            value, frequency, remainder;
+    int               i;
+    float             vec[3];
+
+    value = 0.0;
+    frequency = 1.0;
+    vec[0]=point.x;
+    vec[1]=point.y;
+    vec[2]=point.z;
+
+    for (i=0; i<octaves; i++) {
+	value += noise3_r( ctx, vec ) * pow( frequency, -H );
+	frequency *= lacunarity;
+	vec[0] *= lacunarity;
+	vec[1] *= lacunarity;
+	vec[2] *= lacunarity;
+    }
+
+    remainder = octaves - (int)octaves;
+    if ( remainder )
+	value += remainder * noise3_r( ctx, vec ) * pow( frequency, -H );
+
+    return( value );
+}
+
+
+/* fBm_r() for 'count' points given as separate x, y and z arrays. Each
+   octave is one noise3_array_r() call over a block of points, so it runs on
+   the vector kernels; the results are the same as calling fBm_r(). */
+void fBm_array_r( const NoiseContext *ctx, const float *x, const float *y, const float *z,
+		  double *out, int count, double H, double lacunarity, double octaves )
+{
+    enum { BLOCK = 256 };
+    float             vx[BLOCK], vy[BLOCK], vz[BLOCK], noise[BLOCK];
+    double            frequency, weight, remainder;
+    int               begin, n, i, k;
+
+    remainder = octaves - (int)octaves;
+
+    for (begin = 0; begin < count; begin += BLOCK) {
+	n = count - begin < BLOCK ? count - begin : BLOCK;
+	for (k = 0; k < n; k++) {
+	    vx[k] = x[begin + k];
+	    vy[k] = y[begin + k];
+	    vz[k] = z[begin + k];
+	    out[begin + k] = 0.0;
+	}
+
+	frequency = 1.0;
+	for (i=0; i<octaves; i++) {
+	    weight = pow( frequency, -H );
+	    noise3_array_r( ctx, vx, vy, vz, noise, n );
+	    for (k = 0; k < n; k++) {
+		out[begin + k] += noise[k] * weight;
+		vx[k] *= lacunarity;
+		vy[k] *= lacunarity;
+		vz[k] *= lacunarity;
+	    }
+	    frequency *= lacunarity;
+	}
+
+	if ( remainder ) {
+	    weight = pow( frequency, -H );
+	    noise3_array_r( ctx, vx, vy, vz, noise, n );
+	    for (k = 0; k < n; k++)
+		out[begin + k] += remainder * noise[k] * weight;
+	}
+    }
+}
+
+
 float noise3(float vec[3])
+{
+    noise_init();
+    return noise3_r(default_context, vec);
+}
+
+float noise3_r(const NoiseContext *ctx, const float vec[3])
 {
     int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
     float rx0, rx1, ry0, ry1, rz0, rz1, *q, sy, sz, a, b, c, d, t, u, v;
+    const int *p = ctx->p;
+    float (*g3)[3] = ctx->g3;
     register int i, j;
 
-    if (start) {
-	start = 0;
-	init();
-    }
-
     setup(0, bx0,bx1, rx0,rx1);
     setup(1, by0,by1, ry0,ry1);
     setup(2, bz0,bz1, rz0,rz1);
@@ -153,13 +262,270 @@ float noise3(float vec[3])
     return lerp(sz, c, d);
 }
 
-static void normalize2(float v[2])
+#ifdef FBM_X86_SIMD
+static int cpu_simd_level(void);
+static int simd_level = -1;
+#endif
+
+/* Builds the default context if it has not been built yet. noise3() does
+   this lazily on first use, which is not safe when several threads make
+   that first call at once; call this before handing work to threads. */
+void noise_init(void)
 {
-    float s;
+    if (start) {
+	start = 0;
+	noise_context_destroy(default_context);
+	default_context = noise_context_create(default_seed, DEFAULT_SIZE);
+    }
+}
 
-    s = sqrt(v[0] * v[0] + v[1] * v[1]);
-    v[0] = v[0] / s;
-    v[1] = v[1] / s;
+#ifdef FBM_X86_SIMD
+
+/* The kernels below evaluate exactly the same expressions as noise3(), in
+   the same order and precision, so their results are bit-identical to it.
+   s_curve() is evaluated in double precision because the 3. and 2.
+   constants promote it to double in the scalar code. */
+
+FBM_TARGET_SSE41 static __m128 s_curve_sse41(__m128 t)
+{
+    const __m128d two = _mm_set1_pd(2.), three = _mm_set1_pd(3.);
+    __m128d lo = _mm_cvtps_pd(t);
+    __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(t, t));
+    lo = _mm_mul_pd(_mm_mul_pd(lo, lo), _mm_sub_pd(three, _mm_mul_pd(two, lo)));
+    hi = _mm_mul_pd(_mm_mul_pd(hi, hi), _mm_sub_pd(three, _mm_mul_pd(two, hi)));
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+FBM_TARGET_SSE41 static __m128i gather_sse41(const int *table, __m128i index)
+{
+    __m128i v = _mm_cvtsi32_si128(table[ _mm_cvtsi128_si32(index) ]);
+    v = _mm_insert_epi32(v, table[ _mm_extract_epi32(index, 1) ], 1);
+    v = _mm_insert_epi32(v, table[ _mm_extract_epi32(index, 2) ], 2);
+    return _mm_insert_epi32(v, table[ _mm_extract_epi32(index, 3) ], 3);
+}
+
+/* Dot product of the gradients g3[index] with (rx, ry, rz). Each gradient
+   is loaded as one four-float row (the tables are padded for the last one)
+   and the four rows are transposed into x, y and z vectors. */
+FBM_TARGET_SSE41 static __m128 at3_sse41(const float (*g3)[3], __m128i index,
+					 __m128 rx, __m128 ry, __m128 rz)
+{
+    __m128 q0 = _mm_loadu_ps(g3[ _mm_cvtsi128_si32(index) ]);
+    __m128 q1 = _mm_loadu_ps(g3[ _mm_extract_epi32(index, 1) ]);
+    __m128 q2 = _mm_loadu_ps(g3[ _mm_extract_epi32(index, 2) ]);
+    __m128 q3 = _mm_loadu_ps(g3[ _mm_extract_epi32(index, 3) ]);
+    _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, q0), _mm_mul_ps(ry, q1)), _mm_mul_ps(rz, q2));
+}
+
+#define lerp_sse41(t, a, b) _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)))
+
+/* Evaluates noise3_r() for four points. */
+FBM_TARGET_SSE41 static void noise3_sse41(const NoiseContext *ctx, const float *x, const float *y, const float *z, float *out)
+{
+    const __m128 n = _mm_set1_ps(N), one = _mm_set1_ps(1.0f);
+    const __m128i mask = _mm_set1_epi32(ctx->mask), ione = _mm_set1_epi32(1);
+    const int *p = ctx->p;
+    const float (*g3)[3] = (const float (*)[3])ctx->g3;
+    __m128 t, rx0, rx1, ry0, ry1, rz0, rz1, sx, sy, sz, u, v, a, b, c, d;
+    __m128i it, bx0, bx1, by0, by1, bz0, bz1, i, j, b00, b10, b01, b11;
+
+#define SETUP_SSE41(src, b0, b1, r0, r1) \
+    t = _mm_add_ps(_mm_loadu_ps(src), n); \
+    it = _mm_cvttps_epi32(t); \
+    b0 = _mm_and_si128(it, mask); \
+    b1 = _mm_and_si128(_mm_add_epi32(b0, ione), mask); \
+    r0 = _mm_sub_ps(t, _mm_cvtepi32_ps(it)); \
+    r1 = _mm_sub_ps(r0, one);
+
+    SETUP_SSE41(x, bx0, bx1, rx0, rx1)
+    SETUP_SSE41(y, by0, by1, ry0, ry1)
+    SETUP_SSE41(z, bz0, bz1, rz0, rz1)
+#undef SETUP_SSE41
+
+    i = gather_sse41(p, bx0);
+    j = gather_sse41(p, bx1);
+
+    b00 = gather_sse41(p, _mm_add_epi32(i, by0));
+    b10 = gather_sse41(p, _mm_add_epi32(j, by0));
+    b01 = gather_sse41(p, _mm_add_epi32(i, by1));
+    b11 = gather_sse41(p, _mm_add_epi32(j, by1));
+
+    sx = s_curve_sse41(rx0);
+    sy = s_curve_sse41(ry0);
+    sz = s_curve_sse41(rz0);
+
+    u = at3_sse41(g3, _mm_add_epi32(b00, bz0), rx0, ry0, rz0);
+    v = at3_sse41(g3, _mm_add_epi32(b10, bz0), rx1, ry0, rz0);
+    a = lerp_sse41(sx, u, v);
+
+    u = at3_sse41(g3, _mm_add_epi32(b01, bz0), rx0, ry1, rz0);
+    v = at3_sse41(g3, _mm_add_epi32(b11, bz0), rx1, ry1, rz0);
+    b = lerp_sse41(sx, u, v);
+
+    c = lerp_sse41(sy, a, b);
+
+    u = at3_sse41(g3, _mm_add_epi32(b00, bz1), rx0, ry0, rz1);
+    v = at3_sse41(g3, _mm_add_epi32(b10, bz1), rx1, ry0, rz1);
+    a = lerp_sse41(sx, u, v);
+
+    u = at3_sse41(g3, _mm_add_epi32(b01, bz1), rx0, ry1, rz1);
+    v = at3_sse41(g3, _mm_add_epi32(b11, bz1), rx1, ry1, rz1);
+    b = lerp_sse41(sx, u, v);
+
+    d = lerp_sse41(sy, a, b);
+
+    _mm_storeu_ps(out, lerp_sse41(sz, c, d));
+}
+
+FBM_TARGET_AVX2 static __m256 s_curve_avx2(__m256 t)
+{
+    const __m256d two = _mm256_set1_pd(2.), three = _mm256_set1_pd(3.);
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(t));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(t, 1));
+    lo = _mm256_mul_pd(_mm256_mul_pd(lo, lo), _mm256_sub_pd(three, _mm256_mul_pd(two, lo)));
+    hi = _mm256_mul_pd(_mm256_mul_pd(hi, hi), _mm256_sub_pd(three, _mm256_mul_pd(two, hi)));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+}
+
+#define lerp_avx2(t, a, b) _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)))
+
+/* Evaluates noise3() for eight points, using hardware gathers for the
+   permutation and gradient lookups. */
+FBM_TARGET_AVX2 static void noise3_avx2(const NoiseContext *ctx, const float *x, const float *y, const float *z, float *out)
+{
+    const __m256 n = _mm256_set1_ps(N), one = _mm256_set1_ps(1.0f);
+    const __m256i mask = _mm256_set1_epi32(ctx->mask), ione = _mm256_set1_epi32(1);
+    const __m256i three = _mm256_set1_epi32(3);
+    const int *p = ctx->p;
+    const float *g = &ctx->g3[0][0];
+    __m256 t, rx0, rx1, ry0, ry1, rz0, rz1, sx, sy, sz, u, v, a, b, c, d;
+    __m256i it, bx0, bx1, by0, by1, bz0, bz1, i, j, b00, b10, b01, b11;
+
+#define SETUP_AVX2(src, b0, b1, r0, r1) \
+    t = _mm256_add_ps(_mm256_loadu_ps(src), n); \
+    it = _mm256_cvttps_epi32(t); \
+    b0 = _mm256_and_si256(it, mask); \
+    b1 = _mm256_and_si256(_mm256_add_epi32(b0, ione), mask); \
+    r0 = _mm256_sub_ps(t, _mm256_cvtepi32_ps(it)); \
+    r1 = _mm256_sub_ps(r0, one);
+
+    SETUP_AVX2(x, bx0, bx1, rx0, rx1)
+    SETUP_AVX2(y, by0, by1, ry0, ry1)
+    SETUP_AVX2(z, bz0, bz1, rz0, rz1)
+#undef SETUP_AVX2
+
+    i = _mm256_i32gather_epi32(p, bx0, 4);
+    j = _mm256_i32gather_epi32(p, bx1, 4);
+
+    b00 = _mm256_i32gather_epi32(p, _mm256_add_epi32(i, by0), 4);
+    b10 = _mm256_i32gather_epi32(p, _mm256_add_epi32(j, by0), 4);
+    b01 = _mm256_i32gather_epi32(p, _mm256_add_epi32(i, by1), 4);
+    b11 = _mm256_i32gather_epi32(p, _mm256_add_epi32(j, by1), 4);
+
+    sx = s_curve_avx2(rx0);
+    sy = s_curve_avx2(ry0);
+    sz = s_curve_avx2(rz0);
+
+#define AT3_AVX2(bxy, bz, rx, ry, rz) ( \
+    it = _mm256_mullo_epi32(_mm256_add_epi32(bxy, bz), three), \
+    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, _mm256_i32gather_ps(g, it, 4)), \
+				_mm256_mul_ps(ry, _mm256_i32gather_ps(g + 1, it, 4))), \
+		  _mm256_mul_ps(rz, _mm256_i32gather_ps(g + 2, it, 4))) )
+
+    u = AT3_AVX2(b00, bz0, rx0, ry0, rz0);
+    v = AT3_AVX2(b10, bz0, rx1, ry0, rz0);
+    a = lerp_avx2(sx, u, v);
+
+    u = AT3_AVX2(b01, bz0, rx0, ry1, rz0);
+    v = AT3_AVX2(b11, bz0, rx1, ry1, rz0);
+    b = lerp_avx2(sx, u, v);
+
+    c = lerp_avx2(sy, a, b);
+
+    u = AT3_AVX2(b00, bz1, rx0, ry0, rz1);
+    v = AT3_AVX2(b10, bz1, rx1, ry0, rz1);
+    a = lerp_avx2(sx, u, v);
+
+    u = AT3_AVX2(b01, bz1, rx0, ry1, rz1);
+    v = AT3_AVX2(b11, bz1, rx1, ry1, rz1);
+    b = lerp_avx2(sx, u, v);
+
+    d = lerp_avx2(sy, a, b);
+#undef AT3_AVX2
+
+    _mm256_storeu_ps(out, lerp_avx2(sz, c, d));
+}
+
+enum { SIMD_NONE, SIMD_SSE41, SIMD_AVX2 };
+
+static int cpu_simd_level(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    int level = SIMD_NONE;
+    __cpuid(info, 0);
+    if (info[0] < 1)
+	return level;
+    __cpuid(info, 1);
+    if (info[2] & (1 << 19))
+	level = SIMD_SSE41;
+    /* AVX2 also needs OSXSAVE and AVX, and the OS must save the YMM state. */
+    if ((info[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6)
+	return level;
+    __cpuid(info, 0);
+    if (info[0] < 7)
+	return level;
+    __cpuidex(info, 7, 0);
+    return (info[1] & 0x20) ? SIMD_AVX2 : level;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+	return SIMD_SSE41;
+    return SIMD_NONE;
+#endif
+}
+
+#endif /* FBM_X86_SIMD */
+
+/* Evaluates noise3_r() at 'count' points given as separate x, y and z arrays
+   and stores the results in 'out'. Runs eight points at a time with AVX2 or
+   four with SSE4.1 where the CPU has them; the results are the same as
+   calling noise3_r() for each point. */
+void noise3_array_r(const NoiseContext *ctx, const float *x, const float *y, const float *z,
+		    float *out, int count)
+{
+    int i = 0;
+    float vec[3];
+
+#ifdef FBM_X86_SIMD
+    /* Every thread computes the same answer, so the unsynchronized store is harmless. */
+    if (simd_level < 0)
+	simd_level = cpu_simd_level();
+    if (simd_level >= SIMD_AVX2) {
+	for (; i + 8 <= count; i += 8)
+	    noise3_avx2(ctx, x + i, y + i, z + i, out + i);
+    }
+    if (simd_level >= SIMD_SSE41) {
+	for (; i + 4 <= count; i += 4)
+	    noise3_sse41(ctx, x + i, y + i, z + i, out + i);
+    }
+#endif
+
+    for (; i < count; ++i) {
+	vec[0] = x[i];
+	vec[1] = y[i];
+	vec[2] = z[i];
+	out[i] = noise3_r(ctx, vec);
+    }
+}
+
+void noise3_array(const float *x, const float *y, const float *z, float *out, int count)
+{
+    noise_init();
+    noise3_array_r(default_context, x, y, z, out, count);
 }
 
 static void normalize3(float v[3])
@@ -172,36 +538,115 @@ static void normalize3(float v[3])
     v[2] = v[2] / s;
 }
 
-static void init(void)
+static void random_seed(NoiseRandom *rng, unsigned int seed)
+{
+    int i;
+    long long word;
+
+    rng->r[0] = seed ? seed : 1;
+    for (i = 1 ; i < 31 ; i++) {
+	word = (16807LL * (int)rng->r[i - 1]) % 2147483647;
+	if (word < 0)
+	    word += 2147483647;
+	rng->r[i] = (unsigned int)word;
+    }
+    for (i = 31 ; i < 34 ; i++)
+	rng->r[i] = rng->r[i - 31];
+    rng->i = 34;
+
+    /* glibc discards the first 310 values. */
+    for (i = 0 ; i < 310 ; i++)
+	random_next(rng);
+}
+
+static int random_next(NoiseRandom *rng)
+{
+    unsigned int value = rng->r[(rng->i - 31) % 34] + rng->r[(rng->i - 3) % 34];
+
+    rng->r[rng->i % 34] = value;
+    if (++rng->i == 34 + 34)
+	rng->i = 34;
+    return (int)(value >> 1);
+}
+
+NoiseContext *noise_context_create(unsigned int seed, int size)
 {
+    NoiseContext *ctx;
+    NoiseRandom rng;
     int i, j, k;
-    
-    for (i = 0 ; i < B ; i++) {
-	p[i] = i;
 
-	g1[i] = (float)((rand() % (B + B)) - B) / B;
+    if (size < 2 || size > N || (size & (size - 1)) != 0)
+	return 0;
+
+    ctx = (NoiseContext *)malloc(sizeof(NoiseContext));
+    if (!ctx)
+	return 0;
+    ctx->seed = seed;
+    ctx->size = size;
+    ctx->mask = size - 1;
+    ctx->p = (int *)malloc((size + size + 2) * sizeof(int));
+    /* One float of padding lets the SSE4.1 kernel load the last gradient as a four-float row. */
+    ctx->g3 = (float (*)[3])malloc((size + size + 2) * sizeof(float[3]) + sizeof(float));
+    if (!ctx->p || !ctx->g3) {
+	noise_context_destroy(ctx);
+	return 0;
+    }
+
+    random_seed(&rng, seed);
+
+    for (i = 0 ; i < size ; i++) {
+	ctx->p[i] = i;
 
-	for (j = 0 ; j < 2 ; j++)
-	    g2[i][j] = (float)((rand() % (B + B)) - B) / B;
-	normalize2(g2[i]);
+	/* The g1 and g2 tables of the 1D and 2D noise are gone, but their
+	   draws are kept so that a seed still gives the same g3 and p. */
+	for (j = 0 ; j < 3 ; j++)
+	    random_next(&rng);
 
 	for (j = 0 ; j < 3 ; j++)
-	    g3[i][j] = (float)((rand() % (B + B)) - B) / B;
-	normalize3(g3[i]);
+	    ctx->g3[i][j] = (float)((random_next(&rng) % (size + size)) - size) / size;
+	normalize3(ctx->g3[i]);
     }
 
     while (--i) {
-	k = p[i];
-	p[i] = p[j = rand() % B];
-	p[j] = k;
+	k = ctx->p[i];
+	ctx->p[i] = ctx->p[j = random_next(&rng) % size];
+	ctx->p[j] = k;
     }
 
-    for (i = 0 ; i < B + 2 ; i++) {
-	p[B + i] = p[i];
-	g1[B + i] = g1[i];
-	for (j = 0 ; j < 2 ; j++)
-	    g2[B + i][j] = g2[i][j];
+    for (i = 0 ; i < size + 2 ; i++) {
+	ctx->p[size + i] = ctx->p[i];
 	for (j = 0 ; j < 3 ; j++)
-	    g3[B + i][j] = g3[i][j];
+	    ctx->g3[size + i][j] = ctx->g3[i][j];
     }
+
+    return ctx;
+}
+
+void noise_context_destroy(NoiseContext *ctx)
+{
+    if (!ctx)
+	return;
+    free(ctx->p);
+    free(ctx->g3);
+    free(ctx);
+}
+
+int noise_context_size(const NoiseContext *ctx)
+{
+    return ctx->size;
+}
+
+unsigned int noise_context_seed(const NoiseContext *ctx)
+{
+    return ctx->seed;
+}
+
+const int *noise_context_permutation(const NoiseContext *ctx)
+{
+    return ctx->p;
+}
+
+const float *noise_context_gradients(const NoiseContext *ctx)
+{
+    return ctx->g3[0];
 }
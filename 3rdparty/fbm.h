@@ -26,7 +26,42 @@ typedef struct {
     double z;
 } Vector;
     
+/* A noise context owns the permutation and gradient tables for one seed
+   and lattice size. It is read-only once created, so any number of threads
+   may evaluate noise from the same context at once. 'size' must be a power
+   of two up to 4096; the noise repeats every 'size' units along each axis.
+   noise_context_create() returns 0 for an invalid size. */
+typedef struct NoiseContext NoiseContext;
+
+NoiseContext *noise_context_create(unsigned int seed, int size);
+void noise_context_destroy(NoiseContext *context);
+int noise_context_size(const NoiseContext *context);
+unsigned int noise_context_seed(const NoiseContext *context);
+
+/* The lattice tables, for evaluating the same noise elsewhere, e.g. in a
+   shader. Both have 2 * size + 2 entries: permutation indices into the
+   gradients, and gradients of three floats each. */
+const int *noise_context_permutation(const NoiseContext *context);
+const float *noise_context_gradients(const NoiseContext *context);
+
+float noise3_r(const NoiseContext *context, const float vec[3]);
+double fBm_r(const NoiseContext *context, Vector point, double H, double lacunarity,
+             double octaves);
+
+/* Batch versions: evaluate 'count' points given as separate x, y and z
+   arrays and write the results to 'out'. They use SSE4.1 or AVX2 kernels
+   when the CPU has them and give exactly the same results as the
+   single-point functions. */
+void noise3_array_r(const NoiseContext *context, const float *x, const float *y, const float *z,
+                    float *out, int count);
+void fBm_array_r(const NoiseContext *context, const float *x, const float *y, const float *z,
+                 double *out, int count, double H, double lacunarity, double octaves);
+
+/* The functions below share one process-wide context (seed 1, size 0x20)
+   and are not reentrant. */
 float noise3(float vec[]);
+void noise_init(void);
+void noise3_array(const float *x, const float *y, const float *z, float *out, int count);
 double fBm( Vector point, double H, double lacunarity, double octaves, 
 	    int init );
 #endif
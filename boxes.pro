@@ -1,23 +1,43 @@
 QT += opengl widgets
 
+# noise3_array() must match noise3() bit for bit, so keep a + t * (b - a) from
+# being contracted into fused multiply-adds.
+*-g++*|*-clang*: QMAKE_CFLAGS += -ffp-contract=off
+
 contains(QT_CONFIG, opengles.|angle|dynamicgl):error("This example requires Qt to be configured with -opengl desktop")
 
 HEADERS += 3rdparty/fbm.h \
+           cubemapscheduler.h \
            glbuffers.h \
            glextensions.h \
+           gpunoisevolume.h \
            gltrianglemesh.h \
+           noisevolume.h \
            qtbox.h \
+           resourceregistry.h \
            roundedbox.h \
            scene.h \
+           taskgraph.h \
+           texturecache.h \
+           textureresidency.h \
+           texturestreamer.h \
            trackball.h \
     dialogboxes.h
 SOURCES += 3rdparty/fbm.c \
+           cubemapscheduler.cpp \
            glbuffers.cpp \
            glextensions.cpp \
+           gpunoisevolume.cpp \
            main.cpp \
+           noisevolume.cpp \
            qtbox.cpp \
+           resourceregistry.cpp \
            roundedbox.cpp \
            scene.cpp \
+           taskgraph.cpp \
+           texturecache.cpp \
+           textureresidency.cpp \
+           texturestreamer.cpp \
            trackball.cpp \
     dialogboxes.cpp
 
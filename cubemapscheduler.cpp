@@ -0,0 +1,262 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "cubemapscheduler.h"
+
+#include <algorithm>
+
+// Starting guess for the cost of a face pixel: 0.25 ms for a 256x256 face.
+static const float initialMsPerPixel = 0.25f / (256 * 256);
+
+//============================================================================//
+//                              CubemapScheduler                              //
+//============================================================================//
+
+CubemapScheduler::CubemapScheduler()
+    : m_budget(0.0f)
+    , m_msPerPixel(initialMsPerPixel)
+    , m_frame(0)
+    , m_nextQuery(0)
+    , m_timingQuery(-1)
+    , m_framePixels(0)
+{
+    for (int i = 0; i < QueryCount; ++i) {
+        m_queries[i] = 0;
+        m_queryPixels[i] = 0;
+        m_queryPending[i] = false;
+    }
+}
+
+CubemapScheduler::~CubemapScheduler()
+{
+    if (m_queries[0])
+        glDeleteQueries(QueryCount, m_queries);
+}
+
+void CubemapScheduler::setProbeCount(int count)
+{
+    m_probes.resize(count);
+}
+
+void CubemapScheduler::setProbe(int probe, int size, float screenSize)
+{
+    if (probe < 0 || probe >= m_probes.size())
+        return;
+    if (size != m_probes[probe].size)
+        discard(probe);
+    m_probes[probe].size = size;
+    m_probes[probe].screenSize = screenSize;
+}
+
+void CubemapScheduler::invalidate(int probe)
+{
+    if (probe < 0 || probe >= m_probes.size())
+        return;
+    ++m_probes[probe].version;
+    m_probes[probe].primaryPending = true;
+}
+
+void CubemapScheduler::invalidateAll()
+{
+    for (int i = 0; i < m_probes.size(); ++i)
+        invalidate(i);
+}
+
+void CubemapScheduler::discard(int probe)
+{
+    if (probe < 0 || probe >= m_probes.size())
+        return;
+    invalidate(probe);
+    m_probes[probe].nextFace = 0;
+    m_probes[probe].everRendered = false;
+}
+
+bool CubemapScheduler::isClean(int probe) const
+{
+    const Probe &p = m_probes.at(probe);
+    return p.everRendered && p.renderedVersion == p.version && p.nextFace == 0;
+}
+
+int CubemapScheduler::staleCount() const
+{
+    int count = 0;
+    for (int i = 0; i < m_probes.size(); ++i) {
+        if (m_probes[i].size > 0 && !isClean(i))
+            ++count;
+    }
+    return count;
+}
+
+QVector<CubemapScheduler::Update> CubemapScheduler::schedule(bool all)
+{
+    ++m_frame;
+    QVector<Update> updates;
+
+    // Updates in progress go first, so half-updated probes do not pile up.
+    QList<QPair<float, int> > candidates;
+    for (int i = 0; i < m_probes.size(); ++i) {
+        Probe &p = m_probes[i];
+        if (p.size <= 0)
+            continue;
+        if (all) {
+            p.nextFace = 0;
+            candidates << qMakePair(0.0f, i);
+            continue;
+        }
+        if (isClean(i)) {
+            p.staleSince = -1;
+            continue;
+        }
+        if (p.staleSince < 0)
+            p.staleSince = m_frame;
+        float priority = p.screenSize * (1 + m_frame - p.staleSince);
+        if (p.nextFace > 0 || !p.everRendered)
+            priority += 1e6f;
+        candidates << qMakePair(priority, i);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), higherPriority);
+
+    float remaining = m_budget;
+    for (int c = 0; c < candidates.size(); ++c) {
+        const int i = candidates[c].second;
+        Probe &p = m_probes[i];
+        const float cost = faceCost(p.size);
+        const int facesLeft = 6 - p.nextFace;
+
+        int faces = facesLeft;
+        if (!all && m_budget > 0.0f && p.everRendered && remaining < cost * facesLeft) {
+            faces = int(remaining / cost);
+            if (faces <= 0 && updates.isEmpty())
+                faces = 1;                  // always some progress
+            if (faces <= 0)
+                continue;                   // a smaller probe may still fit
+        }
+        remaining -= cost * faces;
+
+        if (p.nextFace == 0)
+            start(i);
+        if (faces == 6) {
+            Update update = {i, -1};
+            updates << update;
+        } else {
+            for (int face = p.nextFace; face < p.nextFace + faces; ++face) {
+                Update update = {i, face};
+                updates << update;
+            }
+        }
+    }
+    return updates;
+}
+
+void CubemapScheduler::rendered(const Update &update)
+{
+    if (update.probe < 0 || update.probe >= m_probes.size())
+        return;
+    Probe &p = m_probes[update.probe];
+    m_framePixels += qint64(p.size) * p.size * (update.face < 0 ? 6 : 1);
+    if (update.face < 0 || update.face == 5)
+        complete(update.probe);
+    else
+        p.nextFace = update.face + 1;
+}
+
+void CubemapScheduler::start(int probe)
+{
+    Probe &p = m_probes[probe];
+    p.updateVersion = p.version;
+    p.updatePrimary = p.primaryPending;
+    p.primaryPending = false;
+}
+
+void CubemapScheduler::complete(int probe)
+{
+    Probe &p = m_probes[probe];
+    p.nextFace = 0;
+    p.renderedVersion = p.updateVersion;
+    p.everRendered = true;
+    if (isClean(probe))
+        p.staleSince = -1;
+    if (!p.updatePrimary)
+        return;
+    p.updatePrimary = false;
+
+    // The others reflect this probe, but that round stops there.
+    for (int i = 0; i < m_probes.size(); ++i) {
+        if (i != probe)
+            ++m_probes[i].version;
+    }
+}
+
+void CubemapScheduler::beginTiming()
+{
+    m_framePixels = 0;
+    m_timingQuery = -1;
+    if (!getGLExtensionFunctions().timerQuerySupported())
+        return;
+    if (!m_queries[0])
+        glGenQueries(QueryCount, m_queries);
+    collectTimings();
+    if (m_queryPending[m_nextQuery])
+        return;                             // the GPU is behind, skip measuring this frame
+    m_timingQuery = m_nextQuery;
+    m_nextQuery = (m_nextQuery + 1) % QueryCount;
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[m_timingQuery]);
+}
+
+void CubemapScheduler::endTiming()
+{
+    if (m_timingQuery < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    m_queryPixels[m_timingQuery] = m_framePixels;
+    m_queryPending[m_timingQuery] = (m_framePixels > 0);
+    m_timingQuery = -1;
+}
+
+// Folds the finished measurements into the running average.
+void CubemapScheduler::collectTimings()
+{
+    for (int i = 0; i < QueryCount; ++i) {
+        if (!m_queryPending[i])
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint nanoseconds = 0;
+        glGetQueryObjectuiv(m_queries[i], GL_QUERY_RESULT, &nanoseconds);
+        m_queryPending[i] = false;
+        const float msPerPixel = nanoseconds / 1e6f / m_queryPixels[i];
+        m_msPerPixel += 0.2f * (msPerPixel - m_msPerPixel);
+    }
+}
@@ -0,0 +1,131 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef CUBEMAPSCHEDULER_H
+#define CUBEMAPSCHEDULER_H
+
+#include "glextensions.h"
+
+// Decides which dynamic cube maps, "probes", are re-rendered in a frame.
+// The owner calls invalidate() for the probes that see a change; a probe is
+// clean while nothing it sees has changed since its last complete update.
+// Stale probes are updated most important first, on-screen size times the
+// frames they have waited, until the per-frame GPU time budget runs out; a
+// probe that does not fit whole is updated a face at a time over several
+// frames. Probes never rendered yet, or whose contents were lost, are always
+// updated whole. The GPU time of a face pixel is measured with timer queries
+// where the context has them, and guessed otherwise. All calls belong on the
+// GL thread.
+class CubemapScheduler
+{
+public:
+    // One probe to render: all six faces if 'face' is -1.
+    struct Update
+    {
+        int probe;
+        int face;
+    };
+
+    CubemapScheduler();
+    // Needs the GL context to be current.
+    ~CubemapScheduler();
+
+    // New probes start unrendered.
+    void setProbeCount(int count);
+    int probeCount() const {return m_probes.size();}
+    // Face size, 0 for a probe that is not rendered at all, and the weight
+    // of the probe on screen, e.g. its size over its distance to the camera.
+    void setProbe(int probe, int size, float screenSize);
+    // Milliseconds of GPU time per frame, 0 for no limit.
+    void setBudget(float milliseconds) {m_budget = milliseconds;}
+    float budget() const {return m_budget;}
+
+    // Something 'probe' sees has changed. Once the update this causes is
+    // complete, the other probes are invalidated once more, as they see the
+    // probe's reflections; that second round does not spread further.
+    void invalidate(int probe);
+    void invalidateAll();
+    // The contents of 'probe' are undefined, e.g. its render target is new.
+    void discard(int probe);
+    bool isClean(int probe) const;
+    int staleCount() const;
+
+    // The updates for this frame, in order. With 'all', every probe is
+    // rendered whole, clean or not, regardless of the budget.
+    QVector<Update> schedule(bool all = false);
+    // Reports that an update returned by schedule() has been rendered.
+    void rendered(const Update &update);
+
+    // Bracket the rendering of this frame's updates to measure their GPU time.
+    void beginTiming();
+    void endTiming();
+    // Estimated GPU time of one face of 'size', in milliseconds.
+    float faceCost(int size) const {return m_msPerPixel * size * size;}
+
+private:
+    struct Probe
+    {
+        Probe() : size(0), screenSize(0.0f), version(1), renderedVersion(0), updateVersion(0)
+            , nextFace(0), staleSince(-1), primaryPending(true), updatePrimary(false), everRendered(false) {}
+        int size;
+        float screenSize;
+        int version;            // bumped by invalidate()
+        int renderedVersion;    // version the last complete update started at
+        int updateVersion;      // version the update in progress started at
+        int nextFace;           // of the update in progress, 0 if none
+        int staleSince;         // frame the probe became stale, -1 while clean
+        bool primaryPending;    // a change since the last update started came from invalidate()
+        bool updatePrimary;     // the update in progress covers such a change
+        bool everRendered;
+    };
+
+    static bool higherPriority(const QPair<float, int> &a, const QPair<float, int> &b) {return a.first > b.first;}
+    void start(int probe);
+    void complete(int probe);
+    void collectTimings();
+
+    QVector<Probe> m_probes;
+    float m_budget;
+    float m_msPerPixel;         // running average of the measured face cost
+    int m_frame;
+
+    enum {QueryCount = 3};      // results are read a few frames later, without waiting
+    GLuint m_queries[QueryCount];
+    qint64 m_queryPixels[QueryCount];
+    bool m_queryPending[QueryCount];
+    int m_nextQuery;
+    int m_timingQuery;          // query between beginTiming() and endTiming(), -1 if none
+    qint64 m_framePixels;       // face pixels rendered since beginTiming()
+};
+
+#endif
@@ -205,30 +205,11 @@ void GraphicsWidget::paint(QPainter *painter, const QStyleOptionGraphicsItem *op
 //                             RenderOptionsDialog                            //
 //============================================================================//
 
-RenderOptionsDialog::RenderOptionsDialog()
-    : QDialog(0, Qt::CustomizeWindowHint | Qt::WindowTitleHint)
+QList<RenderParameter> RenderOptionsDialog::readParameterFiles()
 {
-    setWindowOpacity(0.75);
-    setWindowTitle(tr("Options (double click to flip)"));
-    QGridLayout *layout = new QGridLayout;
-    setLayout(layout);
-    layout->setColumnStretch(1, 1);
-
-    int row = 0;
-
-    QCheckBox *check = new QCheckBox(tr("Dynamic cube map"));
-    check->setCheckState(Qt::Unchecked);
-    // Dynamic cube maps are only enabled when multi-texturing and render to texture are available.
-    check->setEnabled(glActiveTexture && glGenFramebuffersEXT);
-    connect(check, SIGNAL(stateChanged(int)), this, SIGNAL(dynamicCubemapToggled(int)));
-    layout->addWidget(check, 0, 0, 1, 2);
-    ++row;
-
-    QPalette palette;
-
     // Load all .par files
     // .par files have a simple syntax for specifying user adjustable uniform variables.
-    QSet<QByteArray> uniforms;
+    QList<RenderParameter> parameters;
     QList<QString> filter = QStringList("*.par");
     QList<QFileInfo> files = QDir(":/res/boxes/").entryInfoList(filter, QDir::Files | QDir::Readable);
 
@@ -248,11 +229,14 @@ RenderOptionsDialog::RenderOptionsDialog()
                 char counter[10] = "000000000";
                 int counterPos = 8; // position of last digit
                 while (++it != tokens.end()) {
-                    m_parameterNames << name;
+                    RenderParameter parameter;
+                    parameter.type = type;
+                    parameter.name = name;
+                    parameter.value = *it;
                     if (!singleElement) {
-                        m_parameterNames.back() += "[";
-                        m_parameterNames.back() += counter + counterPos;
-                        m_parameterNames.back() += "]";
+                        parameter.name += "[";
+                        parameter.name += counter + counterPos;
+                        parameter.name += "]";
                         int j = 8; // position of last digit
                         ++counter[j];
                         while (j > 0 && counter[j] > '9') {
@@ -262,29 +246,54 @@ RenderOptionsDialog::RenderOptionsDialog()
                         if (j < counterPos)
                             counterPos = j;
                     }
-
-                    if (type == "color") {
-                        layout->addWidget(new QLabel(m_parameterNames.back()));
-                        bool ok;
-                        ColorEdit *colorEdit = new ColorEdit(it->toUInt(&ok, 16), m_parameterNames.size() - 1);
-                        m_parameterEdits << colorEdit;
-                        layout->addWidget(colorEdit);
-                        connect(colorEdit, SIGNAL(colorChanged(QRgb,int)), this, SLOT(setColorParameter(QRgb,int)));
-                        ++row;
-                    } else if (type == "float") {
-                        layout->addWidget(new QLabel(m_parameterNames.back()));
-                        bool ok;
-                        FloatEdit *floatEdit = new FloatEdit(it->toFloat(&ok), m_parameterNames.size() - 1);
-                        m_parameterEdits << floatEdit;
-                        layout->addWidget(floatEdit);
-                        connect(floatEdit, SIGNAL(valueChanged(float,int)), this, SLOT(setFloatParameter(float,int)));
-                        ++row;
-                    }
+                    parameters << parameter;
                 }
             }
             file.close();
         }
     }
+    return parameters;
+}
+
+RenderOptionsDialog::RenderOptionsDialog(const QList<RenderParameter> &parameters)
+    : QDialog(0, Qt::CustomizeWindowHint | Qt::WindowTitleHint)
+{
+    setWindowOpacity(0.75);
+    setWindowTitle(tr("Options (double click to flip)"));
+    QGridLayout *layout = new QGridLayout;
+    setLayout(layout);
+    layout->setColumnStretch(1, 1);
+
+    int row = 0;
+
+    QCheckBox *check = new QCheckBox(tr("Dynamic cube map"));
+    check->setCheckState(Qt::Unchecked);
+    // Dynamic cube maps are only enabled when multi-texturing and render to texture are available.
+    check->setEnabled(glActiveTexture && glGenFramebuffersEXT);
+    connect(check, SIGNAL(stateChanged(int)), this, SIGNAL(dynamicCubemapToggled(int)));
+    layout->addWidget(check, 0, 0, 1, 2);
+    ++row;
+
+    foreach (const RenderParameter &parameter, parameters) {
+        m_parameterNames << parameter.name;
+        if (parameter.type == "color") {
+            layout->addWidget(new QLabel(m_parameterNames.back()));
+            bool ok;
+            ColorEdit *colorEdit = new ColorEdit(parameter.value.toUInt(&ok, 16), m_parameterNames.size() - 1);
+            m_parameterEdits << colorEdit;
+            layout->addWidget(colorEdit);
+            connect(colorEdit, SIGNAL(colorChanged(QRgb,int)), this, SLOT(setColorParameter(QRgb,int)));
+            ++row;
+        } else if (parameter.type == "float") {
+            layout->addWidget(new QLabel(m_parameterNames.back()));
+            bool ok;
+            FloatEdit *floatEdit = new FloatEdit(parameter.value.toFloat(&ok), m_parameterNames.size() - 1);
+            m_parameterEdits << floatEdit;
+            layout->addWidget(floatEdit);
+            connect(floatEdit, SIGNAL(valueChanged(float,int)), this, SLOT(setFloatParameter(float,int)));
+            ++row;
+        }
+    }
 
     layout->addWidget(new QLabel(tr("Texture:")));
     m_textureCombo = new QComboBox;
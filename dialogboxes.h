@@ -90,13 +90,26 @@ private:
     int m_delta;
 };
 
+// One user adjustable uniform read from a .par file. Array uniforms give one
+// entry per element, named "name[i]".
+struct RenderParameter
+{
+    QByteArray type;    // "color" or "float", other types get no edit
+    QByteArray name;
+    QByteArray value;   // initial value as written in the file
+};
+
 // класс не имеющий отношение к отображению основных объектов
 // отрисовка панели управления
 class RenderOptionsDialog : public QDialog
 {
     Q_OBJECT
 public:
-    RenderOptionsDialog();
+    // Reads the parameters from all .par files. Does not touch any widgets,
+    // so it can run on a worker thread.
+    static QList<RenderParameter> readParameterFiles();
+
+    explicit RenderOptionsDialog(const QList<RenderParameter> &parameters = readParameterFiles());
     int addTexture(const QString &name);
     int addShader(const QString &name);
     void emitParameterChanged();
@@ -32,6 +32,8 @@
 ****************************************************************************/
 
 #include "glbuffers.h"
+#include "taskgraph.h"
+#include "textureresidency.h"
 #include <QtGui/qmatrix4x4.h>
 
 
@@ -48,25 +50,281 @@ void qgluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zF
 //                                  GLTexture                                 //
 //============================================================================//
 
-GLTexture::GLTexture() : m_texture(0), m_failed(false)
+// Bytes of a width x height image stored in 'internalFormat'.
+static qint64 imageBytes(int width, int height, GLenum internalFormat)
+{
+    const qint64 blocks = qint64((width + 3) / 4) * ((height + 3) / 4);
+    if (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+        return blocks * 8;
+    if (internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        return blocks * 16;
+    return qint64(width) * height * 4;
+}
+
+static bool isCompressedFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// Pixel format of uploads to and downloads from an uncompressed 'internalFormat'.
+static GLenum pixelFormat(GLenum internalFormat)
+{
+    if (internalFormat == GL_R8)
+        return GL_RED;
+    if (internalFormat == GL_RG8)
+        return GL_RG;
+    return GL_BGRA;
+}
+
+static int texelBytes(GLenum internalFormat)
+{
+    if (internalFormat == GL_R8)
+        return 1;
+    if (internalFormat == GL_RG8)
+        return 2;
+    return 4;
+}
+
+static int mipLevels(int width, int height, int depth)
+{
+    int levels = 1;
+    for (int size = qMax(width, qMax(height, depth)); size > 1; size /= 2)
+        ++levels;
+    return levels;
+}
+
+GLTexture::GLTexture()
+    : m_texture(0)
+    , m_failed(false)
+    , m_mipmapped(false)
+    , m_storageFormat(0)
+    , m_storageWidth(0)
+    , m_storageHeight(0)
+    , m_storageDepth(0)
+    , m_storageLevels(0)
+    , m_immutable(false)
+    , m_levelBytes(0)
+    , m_byteCount(0)
+    , m_lastBound(0)
 {
     glGenTextures(1, &m_texture);
+    TextureResidency::instance()->add(this);
 }
 
 GLTexture::~GLTexture()
 {
+    TextureResidency::instance()->remove(this, m_byteCount);
     glDeleteTextures(1, &m_texture);
 }
 
+void GLTexture::setLevelBytes(qint64 bytes)
+{
+    m_levelBytes = bytes;
+    updateByteCount();
+}
+
+void GLTexture::touch()
+{
+    m_lastBound = TextureResidency::instance()->tick();
+}
+
+// A full chain adds a third of level 0 in 2D, a seventh in 3D.
+void GLTexture::updateByteCount()
+{
+    qint64 bytes = m_levelBytes;
+    if (m_mipmapped)
+        bytes += m_levelBytes / (target() == GL_TEXTURE_3D ? 7 : 3);
+    TextureResidency::instance()->addTextureBytes(bytes - m_byteCount);
+    m_byteCount = bytes;
+}
+
+bool GLTexture::setMipmapped(bool enabled)
+{
+    if (enabled == m_mipmapped)
+        return true;
+    if (enabled && !glGenerateMipmapEXT) {
+        qWarning("GLTexture::setMipmapped: glGenerateMipmapEXT is not available.");
+        return false;
+    }
+
+    m_mipmapped = enabled;
+    if (enabled && m_immutable && m_storageLevels < mipLevels(m_storageWidth, m_storageHeight,
+                                                              target() == GL_TEXTURE_3D ? m_storageDepth : 1))
+        growMipChain();
+    glBindTexture(target(), m_texture);
+    if (enabled)
+        glGenerateMipmapEXT(target());
+    glTexParameteri(target(), GL_TEXTURE_MIN_FILTER, enabled ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glBindTexture(target(), 0);
+    updateByteCount();
+    return true;
+}
+
+void GLTexture::updateMipmaps()
+{
+    if (!m_mipmapped)
+        return;
+    glBindTexture(target(), m_texture);
+    glGenerateMipmapEXT(target());
+    glBindTexture(target(), 0);
+}
+
+bool GLTexture::allocate(GLenum internalFormat, int width, int height, int depth)
+{
+    // Array layers keep their number in every level, only a 3D texture halves its depth.
+    const int levels = m_mipmapped ? mipLevels(width, height, target() == GL_TEXTURE_3D ? depth : 1) : 1;
+    glBindTexture(target(), m_texture);
+    if (internalFormat == m_storageFormat && width == m_storageWidth && height == m_storageHeight
+        && depth == m_storageDepth && (!m_immutable || levels <= m_storageLevels))
+        return false;
+
+    releaseStorage();
+    const bool immutable = getGLExtensionFunctions().textureStorageSupported() && !isCompressedFormat(internalFormat);
+    // glTexStorage wants a sized format, '4' is the unsized one the rest of the code uses.
+    const GLenum sizedFormat = internalFormat == 4 ? GLenum(GL_RGBA8) : internalFormat;
+    const GLenum pixels = pixelFormat(internalFormat);
+    switch (target()) {
+    case GL_TEXTURE_2D:
+        if (immutable)
+            glTexStorage2D(GL_TEXTURE_2D, levels, sizedFormat, width, height);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, pixels, GL_UNSIGNED_BYTE, 0);
+        break;
+    case GL_TEXTURE_CUBE_MAP:
+        if (immutable) {
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, sizedFormat, width, height);
+        } else {
+            for (int face = 0; face < 6; ++face)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, width, height, 0,
+                    pixels, GL_UNSIGNED_BYTE, 0);
+        }
+        break;
+    default:    // GL_TEXTURE_3D and GL_TEXTURE_2D_ARRAY_EXT
+        if (immutable)
+            glTexStorage3D(target(), levels, sizedFormat, width, height, depth);
+        else
+            glTexImage3D(target(), 0, internalFormat, width, height, depth, 0, pixels, GL_UNSIGNED_BYTE, 0);
+        break;
+    }
+    recordStorage(internalFormat, width, height, depth, immutable ? levels : 1, immutable);
+    return true;
+}
+
+void GLTexture::releaseStorage()
+{
+    if (!m_immutable)
+        return;
+
+    GLint wrapS, wrapT, wrapR, magFilter, minFilter;
+    glBindTexture(target(), m_texture);
+    glGetTexParameteriv(target(), GL_TEXTURE_WRAP_S, &wrapS);
+    glGetTexParameteriv(target(), GL_TEXTURE_WRAP_T, &wrapT);
+    glGetTexParameteriv(target(), GL_TEXTURE_WRAP_R, &wrapR);
+    glGetTexParameteriv(target(), GL_TEXTURE_MAG_FILTER, &magFilter);
+    glGetTexParameteriv(target(), GL_TEXTURE_MIN_FILTER, &minFilter);
+    glBindTexture(target(), 0);
+    glDeleteTextures(1, &m_texture);
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(target(), m_texture);
+    glTexParameteri(target(), GL_TEXTURE_WRAP_S, wrapS);
+    glTexParameteri(target(), GL_TEXTURE_WRAP_T, wrapT);
+    glTexParameteri(target(), GL_TEXTURE_WRAP_R, wrapR);
+    glTexParameteri(target(), GL_TEXTURE_MAG_FILTER, magFilter);
+    glTexParameteri(target(), GL_TEXTURE_MIN_FILTER, minFilter);
+    recordStorage(0, 0, 0, 0, 0, false);
+}
+
+void GLTexture::setStorage(GLenum internalFormat, int width, int height, int depth)
+{
+    recordStorage(internalFormat, width, height, depth, 1, false);
+}
+
+void GLTexture::recordStorage(GLenum internalFormat, int width, int height, int depth, int levels, bool immutable)
+{
+    m_storageFormat = internalFormat;
+    m_storageWidth = width;
+    m_storageHeight = height;
+    m_storageDepth = depth;
+    m_storageLevels = levels;
+    m_immutable = immutable;
+
+    qint64 bytes = isCompressedFormat(internalFormat) ? imageBytes(width, height, internalFormat)
+                                                      : qint64(width) * height * texelBytes(internalFormat);
+    bytes *= depth;
+    if (target() == GL_TEXTURE_CUBE_MAP)
+        bytes *= 6;
+    setLevelBytes(bytes);
+}
+
+// Immutable storage cannot gain levels, so level 0 is read back and moved
+// into new storage with a full chain. Only setMipmapped() needs this.
+void GLTexture::growMipChain()
+{
+    const GLenum format = m_storageFormat;
+    const int width = m_storageWidth, height = m_storageHeight, depth = m_storageDepth;
+    const GLenum pixels = pixelFormat(format);
+    const int faces = target() == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+    const int faceBytes = width * height * depth * texelBytes(format);
+    QByteArray data(faceBytes * faces, Qt::Uninitialized);
+
+    glBindTexture(target(), m_texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (int face = 0; face < faces; ++face)
+        glGetTexImage(faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target(), 0, pixels, GL_UNSIGNED_BYTE,
+            data.data() + face * faceBytes);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    allocate(format, width, height, depth);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int face = 0; face < faces; ++face) {
+        const char *texels = data.constData() + face * faceBytes;
+        if (target() == GL_TEXTURE_2D || target() == GL_TEXTURE_CUBE_MAP)
+            glTexSubImage2D(faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target(), 0, 0, 0, width, height,
+                pixels, GL_UNSIGNED_BYTE, texels);
+        else
+            glTexSubImage3D(target(), 0, 0, 0, 0, width, height, depth, pixels, GL_UNSIGNED_BYTE, texels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(target(), 0);
+}
+
+QByteArray GLTexture::readImage(GLenum image, GLenum *format) const
+{
+    QByteArray data;
+    GLint compressed = GL_FALSE;
+    GLint width = 0, height = 0;
+    glBindTexture(target(), m_texture);
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(image, 0, GL_TEXTURE_HEIGHT, &height);
+    if (compressed == GL_TRUE && glGetCompressedTexImage) {
+        GLint byteCount = 0, internalFormat = 0;
+        glGetTexLevelParameteriv(image, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &byteCount);
+        glGetTexLevelParameteriv(image, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        data.resize(byteCount);
+        glGetCompressedTexImage(image, 0, data.data());
+        *format = GLenum(internalFormat);
+    } else {
+        data.resize(width * height * 4);
+        glGetTexImage(image, 0, GL_BGRA, GL_UNSIGNED_BYTE, data.data());
+        *format = GL_BGRA;
+    }
+    glBindTexture(target(), 0);
+    return data;
+}
+
 //============================================================================//
 //                                 GLTexture2D                                //
 //============================================================================//
 
-GLTexture2D::GLTexture2D(int width, int height)
+GLTexture2D::GLTexture2D(int width, int height, bool allocateStorage)
 {
-    glBindTexture(GL_TEXTURE_2D, m_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0,
-        GL_BGRA, GL_UNSIGNED_BYTE, 0);
+    if (allocateStorage)
+        allocate(4, width, height);
+    else
+        glBindTexture(GL_TEXTURE_2D, m_texture);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -81,8 +339,16 @@ GLTexture2D::GLTexture2D(int width, int height)
 GLTexture2D::GLTexture2D(const QString& fileName, int width, int height)
 {
     // TODO: Add error handling.
-    QImage image(fileName);
+    loadImage(QImage(fileName), width, height);
+}
+
+GLTexture2D::GLTexture2D(const QImage& image, int width, int height)
+{
+    loadImage(image, width, height);
+}
 
+void GLTexture2D::loadImage(QImage image, int width, int height)
+{
     if (image.isNull()) {
         m_failed = true;
         return;
@@ -98,11 +364,11 @@ GLTexture2D::GLTexture2D(const QString& fileName, int width, int height)
     if (width != image.width() || height != image.height())
         image = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 
-    glBindTexture(GL_TEXTURE_2D, m_texture);
+    allocate(4, image.width(), image.height());
 
     // Works on x86, so probably works on all little-endian systems.
     // Does it work on big-endian systems?
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, image.width(), image.height(), 0,
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width(), image.height(),
         GL_BGRA, GL_UNSIGNED_BYTE, image.bits());
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -114,16 +380,36 @@ GLTexture2D::GLTexture2D(const QString& fileName, int width, int height)
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void GLTexture2D::load(int width, int height, QRgb *data)
+void GLTexture2D::load(int width, int height, const QRgb *data, GLenum internalFormat)
+{
+    if (isCompressedFormat(internalFormat)) {
+        releaseStorage();
+        glBindTexture(GL_TEXTURE_2D, m_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+            GL_BGRA, GL_UNSIGNED_BYTE, data);
+        setStorage(internalFormat, width, height);
+    } else {
+        allocate(internalFormat, width, height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+            GL_BGRA, GL_UNSIGNED_BYTE, data);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GLTexture2D::loadCompressed(int width, int height, GLenum format, const void *data, int byteCount)
 {
+    GLBUFFERS_ASSERT_OPENGL("GLTexture2D::loadCompressed", glCompressedTexImage2D, return)
+
+    releaseStorage();
     glBindTexture(GL_TEXTURE_2D, m_texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, width, height, 0,
-        GL_BGRA, GL_UNSIGNED_BYTE, data);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, byteCount, data);
     glBindTexture(GL_TEXTURE_2D, 0);
+    setStorage(format, width, height);
 }
 
 void GLTexture2D::bind()
 {
+    touch();
     glBindTexture(GL_TEXTURE_2D, m_texture);
     glEnable(GL_TEXTURE_2D);
 }
@@ -139,13 +425,26 @@ void GLTexture2D::unbind()
 //                                 GLTexture3D                                //
 //============================================================================//
 
-GLTexture3D::GLTexture3D(int width, int height, int depth)
+GLTexture3D::GLTexture3D(int width, int height, int depth, int channels)
+    : m_width(width)
+    , m_height(height)
+    , m_depth(depth)
+    , m_channels(4)
+    , m_internalFormat(4)
+    , m_format(GL_BGRA)
 {
     GLBUFFERS_ASSERT_OPENGL("GLTexture3D::GLTexture3D", glTexImage3D, return)
 
-    glBindTexture(GL_TEXTURE_3D, m_texture);
-    glTexImage3D(GL_TEXTURE_3D, 0, 4, width, height, depth, 0,
-        GL_BGRA, GL_UNSIGNED_BYTE, 0);
+    m_channels = storedChannels(channels);
+    if (m_channels == 1) {
+        m_internalFormat = GL_R8;
+        m_format = GL_RED;
+    } else if (m_channels == 2) {
+        m_internalFormat = GL_RG8;
+        m_format = GL_RG;
+    }
+
+    allocate(m_internalFormat, width, height, depth);
 
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -157,18 +456,53 @@ GLTexture3D::GLTexture3D(int width, int height, int depth)
     glBindTexture(GL_TEXTURE_3D, 0);
 }
 
-void GLTexture3D::load(int width, int height, int depth, QRgb *data)
+int GLTexture3D::storedChannels(int channels)
 {
-    GLBUFFERS_ASSERT_OPENGL("GLTexture3D::load", glTexImage3D, return)
+    if ((channels == 1 || channels == 2) && getGLExtensionFunctions().textureRGSupported())
+        return channels;
+    return 4;
+}
+
+void GLTexture3D::load(int width, int height, int depth, const void *data)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLTexture3D::load", glTexSubImage3D, return)
+
+    allocate(m_internalFormat, width, height, depth);
+    m_width = width;
+    m_height = height;
+    m_depth = depth;
+    // Rows of one- and two-byte texels need not be four-byte aligned.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, width, height, depth,
+        m_format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void GLTexture3D::loadSlab(int zOffset, int depth, const void *data)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLTexture3D::loadSlab", glTexSubImage3D, return)
 
     glBindTexture(GL_TEXTURE_3D, m_texture);
-    glTexImage3D(GL_TEXTURE_3D, 0, 4, width, height, depth, 0,
-        GL_BGRA, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, zOffset, m_width, m_height, depth,
+        m_format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void GLTexture3D::read(void *data)
+{
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_3D, 0, m_format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
     glBindTexture(GL_TEXTURE_3D, 0);
 }
 
 void GLTexture3D::bind()
 {
+    touch();
     glBindTexture(GL_TEXTURE_3D, m_texture);
     glEnable(GL_TEXTURE_3D);
 }
@@ -180,16 +514,68 @@ void GLTexture3D::unbind()
 }
 
 //============================================================================//
-//                                GLTextureCube                               //
+//                              GLTexture2DArray                              //
 //============================================================================//
 
-GLTextureCube::GLTextureCube(int size)
+GLTexture2DArray::GLTexture2DArray(int width, int height, int layers)
+    : m_width(width)
+    , m_height(height)
+    , m_layers(layers)
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
+    GLBUFFERS_ASSERT_OPENGL("GLTexture2DArray::GLTexture2DArray", isSupported(), return)
 
-    for (int i = 0; i < 6; ++i)
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 4, size, size, 0,
-            GL_BGRA, GL_UNSIGNED_BYTE, 0);
+    allocate(4, width, height, layers);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+}
+
+bool GLTexture2DArray::isSupported()
+{
+    return getGLExtensionFunctions().textureArraySupported()
+            && glTexImage3D && glTexSubImage3D;
+}
+
+void GLTexture2DArray::load(int layer, const QRgb *data)
+{
+    if (m_failed)
+        return;
+    if (layer < 0 || layer >= m_layers) {
+        qWarning("GLTexture2DArray::load: Layer %d is out of range.", layer);
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, m_texture);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY_EXT, 0, 0, 0, layer, m_width, m_height, 1,
+        GL_BGRA, GL_UNSIGNED_BYTE, data);
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+}
+
+void GLTexture2DArray::bind()
+{
+    touch();
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, m_texture);
+}
+
+void GLTexture2DArray::unbind()
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY_EXT, 0);
+}
+
+//============================================================================//
+//                                GLTextureCube                               //
+//============================================================================//
+
+GLTextureCube::GLTextureCube(int size, bool allocateStorage)
+    : m_size(size)
+{
+    if (allocateStorage)
+        allocate(4, size, size);
+    else
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -201,43 +587,88 @@ GLTextureCube::GLTextureCube(int size)
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
+void GLTextureCube::resize(int size)
+{
+    allocate(4, size, size);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    m_size = size;
+}
+
+// Decodes one face for GLTextureCube and releases 'done'.
+class CubeFaceTask : public QRunnable
+{
+public:
+    CubeFaceTask(const QString &fileName, int size, QImage *image, QSemaphore *done)
+        : m_fileName(fileName), m_size(size), m_image(image), m_done(done) {}
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        *m_image = GLTextureCube::loadFace(m_fileName, m_size);
+        m_done->release();
+    }
+private:
+    QString m_fileName;
+    int m_size;
+    QImage *m_image;
+    QSemaphore *m_done;
+};
+
 GLTextureCube::GLTextureCube(const QStringList& fileNames, int size)
+    : m_size(0)
 {
     // TODO: Add error handling.
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
+    // Decode, convert and scale all faces at once, so loading takes about as
+    // long as the slowest face. Called from a pool thread, the faces are
+    // decoded right here instead: waiting for the pool there could deadlock.
+    const int count = qMin(fileNames.size(), 6);
+    QImage images[6];
+    QSemaphore decoded[6];
+    WorkStealingPool *pool = WorkStealingPool::globalInstance();
+    const bool onPoolThread = pool->currentWorker() >= 0;
+    for (int i = 0; i < count; ++i) {
+        CubeFaceTask *task = new CubeFaceTask(fileNames.at(i), size, &images[i], &decoded[i]);
+        if (onPoolThread) {
+            task->run();
+            delete task;
+        } else {
+            pool->start(task);
+        }
+    }
 
     int index = 0;
-    foreach (QString file, fileNames) {
-        QImage image(file);
+    for (; index < count; ++index) {
+        decoded[index].acquire();
+        QImage &image = images[index];
         if (image.isNull()) {
             m_failed = true;
             break;
         }
 
-        image = image.convertToFormat(QImage::Format_ARGB32);
-
         //qDebug() << "Image size:" << image.width() << "x" << image.height();
         if (size <= 0)
             size = image.width();
+        // Only when the size was taken from the first face.
         if (size != image.width() || size != image.height())
             image = image.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 
+        // All faces at once, as soon as the size is known.
+        if (index == 0)
+            allocate(4, size, size);
+
         // Works on x86, so probably works on all little-endian systems.
         // Does it work on big-endian systems?
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index, 0, 4, image.width(), image.height(), 0,
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index, 0, 0, 0, image.width(), image.height(),
             GL_BGRA, GL_UNSIGNED_BYTE, image.bits());
-
-        if (++index == 6)
-            break;
-    }
-
-    // Clear remaining faces.
-    while (index < 6) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index, 0, 4, size, size, 0,
-            GL_BGRA, GL_UNSIGNED_BYTE, 0);
-        ++index;
     }
+    // The faces after a failed one are still being written to.
+    for (int i = index + 1; i < count; ++i)
+        decoded[i].acquire();
+
+    // The remaining faces keep undefined contents.
+    m_size = qMax(size, 0);
+    if (m_size > 0)
+        allocate(4, m_size, m_size);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -249,16 +680,51 @@ GLTextureCube::GLTextureCube(const QStringList& fileNames, int size)
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
-void GLTextureCube::load(int size, int face, QRgb *data)
+QImage GLTextureCube::loadFace(const QString &fileName, int size)
 {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 4, size, size, 0,
+    QImage image(fileName);
+    if (image.isNull())
+        return image;
+    image = image.convertToFormat(QImage::Format_ARGB32);
+    if (size > 0 && (size != image.width() || size != image.height()))
+        image = image.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return image;
+}
+
+void GLTextureCube::load(int size, int face, const QRgb *data, GLenum internalFormat)
+{
+    if (isCompressedFormat(internalFormat)) {
+        if (face == 0)
+            releaseStorage();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, size, size, 0,
+            GL_BGRA, GL_UNSIGNED_BYTE, data);
+        setStorage(internalFormat, size, size);
+    } else {
+        allocate(internalFormat, size, size);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, size, size,
             GL_BGRA, GL_UNSIGNED_BYTE, data);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    m_size = size;
+}
+
+void GLTextureCube::loadCompressed(int size, int face, GLenum format, const void *data, int byteCount)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLTextureCube::loadCompressed", glCompressedTexImage2D, return)
+
+    if (face == 0)
+        releaseStorage();
+    glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
+    glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, format, size, size, 0, byteCount, data);
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    m_size = size;
+    setStorage(format, size, size);
 }
 
 void GLTextureCube::bind()
 {
+    touch();
     glBindTexture(GL_TEXTURE_CUBE_MAP, m_texture);
     glEnable(GL_TEXTURE_CUBE_MAP);
 }
@@ -269,13 +735,150 @@ void GLTextureCube::unbind()
     glDisable(GL_TEXTURE_CUBE_MAP);
 }
 
+//============================================================================//
+//                             GLDepthBufferPool                              //
+//============================================================================//
+
+GLDepthBufferPool *GLDepthBufferPool::instance()
+{
+    static GLDepthBufferPool pool;
+    return &pool;
+}
+
+void GLDepthBufferPool::addUser(int width, int height, GLenum format)
+{
+    Key key = {width, height, format};
+    ++m_entries[key].users;
+}
+
+void GLDepthBufferPool::removeUser(int width, int height, GLenum format)
+{
+    Key key = {width, height, format};
+    QHash<Key, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+    if (--it->users > 0 || it->borrowed[0] > 0 || it->borrowed[1] > 0)
+        return;
+
+    // Last target of this size is gone, so are its buffers.
+    deleteBuffers(key, *it);
+    m_entries.erase(it);
+}
+
+void GLDepthBufferPool::deleteBuffers(const Key &key, Entry &entry)
+{
+    if (!entry.free[0].isEmpty()) {
+        TextureResidency::instance()->addRenderBufferBytes(-bufferBytes(key, false) * entry.free[0].size());
+        if (glDeleteRenderbuffersEXT)
+            glDeleteRenderbuffersEXT(entry.free[0].size(), entry.free[0].constData());
+    }
+    if (!entry.free[1].isEmpty()) {
+        TextureResidency::instance()->addRenderBufferBytes(-bufferBytes(key, true) * entry.free[1].size());
+        glDeleteTextures(entry.free[1].size(), entry.free[1].constData());
+    }
+    entry.free[0].clear();
+    entry.free[1].clear();
+}
+
+GLuint GLDepthBufferPool::acquire(int width, int height, GLenum format, bool layered)
+{
+    if (!glGenRenderbuffersEXT || !glBindRenderbufferEXT || !glRenderbufferStorageEXT) {
+        qCritical("GLDepthBufferPool::acquire: The necessary OpenGL functions are not available.");
+        return 0;
+    }
+
+    Key key = {width, height, format};
+    Entry &entry = m_entries[key];
+    GLuint buffer = 0;
+    if (!entry.free[layered].isEmpty()) {
+        buffer = entry.free[layered].last();
+        entry.free[layered].pop_back();
+    } else if (!layered) {
+        // Only when targets of the same size render nested.
+        glGenRenderbuffersEXT(1, &buffer);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, buffer);
+        glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, format, width, height);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+        TextureResidency::instance()->addRenderBufferBytes(bufferBytes(key, false));
+    } else {
+        // Depth cube maps need a sized format.
+        const GLenum internalFormat = (format == GL_DEPTH_COMPONENT ? GL_DEPTH_COMPONENT24 : format);
+        glGenTextures(1, &buffer);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, buffer);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        for (int face = 0; face < 6; ++face) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, width, height, 0,
+                GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        TextureResidency::instance()->addRenderBufferBytes(bufferBytes(key, true));
+    }
+    ++entry.borrowed[layered];
+    m_borrowed.insert(borrowedKey(buffer, layered), key);
+    return buffer;
+}
+
+void GLDepthBufferPool::release(GLuint buffer, bool layered)
+{
+    QHash<quint64, Key>::iterator it = m_borrowed.find(borrowedKey(buffer, layered));
+    if (it == m_borrowed.end()) {
+        qWarning("GLDepthBufferPool::release: Buffer %u was not borrowed from the pool.", buffer);
+        return;
+    }
+    const Key key = it.value();
+    m_borrowed.erase(it);
+
+    Entry &entry = m_entries[key];
+    --entry.borrowed[layered];
+    entry.free[layered].append(buffer);
+    if (entry.users <= 0) {
+        // Its target was destroyed while rendering.
+        ++entry.users;
+        removeUser(key.width, key.height, key.format);
+    }
+}
+
+int GLDepthBufferPool::bufferCount() const
+{
+    int count = 0;
+    foreach (const Entry &entry, m_entries) {
+        for (int layered = 0; layered < 2; ++layered)
+            count += entry.free[layered].size() + entry.borrowed[layered];
+    }
+    return count;
+}
+
+qint64 GLDepthBufferPool::bytes() const
+{
+    qint64 total = 0;
+    for (QHash<Key, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        for (int layered = 0; layered < 2; ++layered)
+            total += bufferBytes(it.key(), layered) * (it->free[layered].size() + it->borrowed[layered]);
+    }
+    return total;
+}
+
+qint64 GLDepthBufferPool::savedBytes() const
+{
+    qint64 unshared = 0;
+    for (QHash<Key, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        // Layered rendering holds a cube map where each target would hold one.
+        const bool layered = !it->free[1].isEmpty() || it->borrowed[1] > 0;
+        unshared += bufferBytes(it.key(), layered) * it->users;
+    }
+    return unshared - bytes();
+}
+
 //============================================================================//
 //                            GLFrameBufferObject                             //
 //============================================================================//
 
-GLFrameBufferObject::GLFrameBufferObject(int width, int height)
+GLFrameBufferObject::GLFrameBufferObject(int width, int height, GLenum depthFormat)
     : m_fbo(0)
     , m_depthBuffer(0)
+    , m_depthFormat(depthFormat)
+    , m_depthLayered(false)
     , m_width(width)
     , m_height(height)
     , m_failed(false)
@@ -283,39 +886,71 @@ GLFrameBufferObject::GLFrameBufferObject(int width, int height)
     GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::GLFrameBufferObject",
         glGenFramebuffersEXT && glGenRenderbuffersEXT && glBindRenderbufferEXT && glRenderbufferStorageEXT, return)
 
-    // TODO: share depth buffers of same size
     glGenFramebuffersEXT(1, &m_fbo);
-    //glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_fbo);
-    glGenRenderbuffersEXT(1, &m_depthBuffer);
-    glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, m_depthBuffer);
-    glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, m_width, m_height);
-    //glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, m_depthBuffer);
-    //glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    if (m_depthFormat)
+        GLDepthBufferPool::instance()->addUser(m_width, m_height, m_depthFormat);
 }
 
 GLFrameBufferObject::~GLFrameBufferObject()
 {
-    GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::~GLFrameBufferObject",
-        glDeleteFramebuffersEXT && glDeleteRenderbuffersEXT, return)
+    if (m_depthBuffer)
+        GLDepthBufferPool::instance()->release(m_depthBuffer, m_depthLayered);
+    if (m_fbo && m_depthFormat)
+        GLDepthBufferPool::instance()->removeUser(m_width, m_height, m_depthFormat);
+    GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::~GLFrameBufferObject", glDeleteFramebuffersEXT, return)
 
     glDeleteFramebuffersEXT(1, &m_fbo);
-    glDeleteRenderbuffersEXT(1, &m_depthBuffer);
 }
 
-void GLFrameBufferObject::setAsRenderTarget(bool state)
+void GLFrameBufferObject::setAsRenderTarget(bool state, bool layered)
 {
-    GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::setAsRenderTarget", glBindFramebufferEXT, return)
+    GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::setAsRenderTarget",
+        glBindFramebufferEXT && glFramebufferRenderbufferEXT && (!layered || glFramebufferTextureEXT), return)
 
     if (state) {
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_fbo);
         glPushAttrib(GL_VIEWPORT_BIT);
         glViewport(0, 0, m_width, m_height);
+        if (m_depthBuffer && m_depthLayered != layered)
+            detachDepthBuffer();
+        if (m_depthFormat && !m_depthBuffer) {
+            m_depthBuffer = GLDepthBufferPool::instance()->acquire(m_width, m_height, m_depthFormat, layered);
+            m_depthLayered = layered;
+        }
+        if (m_depthBuffer && layered)
+            glFramebufferTextureEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, m_depthBuffer, 0);
+        else if (m_depthBuffer)
+            glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, m_depthBuffer);
     } else {
+        if (m_depthBuffer)
+            detachDepthBuffer();
         glPopAttrib();
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
     }
 }
 
+void GLFrameBufferObject::detachDepthBuffer()
+{
+    if (m_depthLayered)
+        glFramebufferTextureEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, 0, 0);
+    else
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, 0);
+    GLDepthBufferPool::instance()->release(m_depthBuffer, m_depthLayered);
+    m_depthBuffer = 0;
+}
+
+void GLFrameBufferObject::resize(int width, int height)
+{
+    if (width == m_width && height == m_height)
+        return;
+    if (m_fbo && m_depthFormat) {
+        GLDepthBufferPool::instance()->removeUser(m_width, m_height, m_depthFormat);
+        GLDepthBufferPool::instance()->addUser(width, height, m_depthFormat);
+    }
+    m_width = width;
+    m_height = height;
+}
+
 bool GLFrameBufferObject::isComplete()
 {
     GLBUFFERS_ASSERT_OPENGL("GLFrameBufferObject::isComplete", glCheckFramebufferStatusEXT, return false)
@@ -323,30 +958,237 @@ bool GLFrameBufferObject::isComplete()
     return GL_FRAMEBUFFER_COMPLETE_EXT == glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
 }
 
+//============================================================================//
+//                              GLRenderTarget2D                              //
+//============================================================================//
+
+static int clampedSamples(int samples)
+{
+    if (samples <= 1)
+        return 0;
+    const int maximum = GLRenderTarget2D::maxSamples();
+    if (samples > maximum)
+        qWarning("GLRenderTarget2D: %d samples requested, %d available.", samples, maximum);
+    return qMin(samples, maximum) > 1 ? qMin(samples, maximum) : 0;
+}
+
+GLRenderTarget2D::GLRenderTarget2D(int width, int height, int samples)
+    : GLTexture2D(width, height)
+    , m_width(width)
+    , m_height(height)
+    , m_samples(clampedSamples(samples))
+    , m_fbo(width, height, m_samples ? 0 : GL_DEPTH_COMPONENT)
+    , m_sampleFbo(0)
+{
+    m_sampleBuffers[0] = m_sampleBuffers[1] = 0;
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTarget2D::GLRenderTarget2D",
+        glBindFramebufferEXT && glFramebufferTexture2DEXT, return)
+
+    // The view is drawn once into the whole target, no tiling.
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_samples) {
+        glGenFramebuffersEXT(1, &m_sampleFbo);
+        glGenRenderbuffersEXT(2, m_sampleBuffers);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, m_sampleBuffers[0]);
+        glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, m_samples, GL_RGBA8, m_width, m_height);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, m_sampleBuffers[1]);
+        glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER_EXT, m_samples, GL_DEPTH_COMPONENT24, m_width, m_height);
+        glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, 0);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_sampleFbo);
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, m_sampleBuffers[0]);
+        glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, m_sampleBuffers[1]);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+        TextureResidency::instance()->addRenderBufferBytes(qint64(m_width) * m_height * 8 * m_samples);  // color and depth
+    }
+}
+
+GLRenderTarget2D::~GLRenderTarget2D()
+{
+    if (!m_sampleFbo)
+        return;
+    TextureResidency::instance()->addRenderBufferBytes(-qint64(m_width) * m_height * 8 * m_samples);
+    glDeleteFramebuffersEXT(1, &m_sampleFbo);
+    glDeleteRenderbuffersEXT(2, m_sampleBuffers);
+}
+
+int GLRenderTarget2D::maxSamples()
+{
+    if (!getGLExtensionFunctions().framebufferMultisampleSupported())
+        return 0;
+    GLint samples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES_EXT, &samples);
+    return samples;
+}
+
+// The texture is attached on every use, like GLRenderTargetCube does: with
+// immutable storage, setMipmapped() replaces the texture object.
+void GLRenderTarget2D::begin()
+{
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTarget2D::begin", glFramebufferTexture2DEXT, return)
+
+    if (!m_sampleFbo) {
+        m_fbo.setAsRenderTarget(true);
+        glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, m_texture, 0);
+        return;
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, m_sampleFbo);
+    glPushAttrib(GL_VIEWPORT_BIT);
+    glViewport(0, 0, m_width, m_height);
+}
+
+void GLRenderTarget2D::end()
+{
+    if (!m_sampleFbo) {
+        m_fbo.setAsRenderTarget(false);
+    } else {
+        glPopAttrib();
+        glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, m_sampleFbo);
+        glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, m_fbo.m_fbo);
+        glFramebufferTexture2DEXT(GL_DRAW_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, m_texture, 0);
+        glBlitFramebufferEXT(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    }
+    updateMipmaps();
+}
+
+QImage GLRenderTarget2D::toImage()
+{
+    QImage image(m_width, m_height, QImage::Format_ARGB32);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, image.bits());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return image.mirrored();        // OpenGL stores the bottom row first
+}
+
 //============================================================================//
 //                             GLRenderTargetCube                             //
 //============================================================================//
 
-GLRenderTargetCube::GLRenderTargetCube(int size)
+GLRenderTargetCube::GLRenderTargetCube(int size, int minSize)
     : GLTextureCube(size)
     , m_fbo(size, size)
+    , m_maxSize(size)
+    , m_tierCount(1)
+    , m_tier(0)
+    , m_face(0)
+    , m_renderedFaces(0)
 {
+    while (minSize > 0 && tierSize(m_tierCount) >= minSize)
+        ++m_tierCount;
+}
+
+void GLRenderTargetCube::setTier(int tier)
+{
+    tier = qBound(0, tier, m_tierCount - 1);
+    if (tier == m_tier)
+        return;
+    m_tier = tier;
+    resize(tierSize(tier));
+    m_fbo.resize(size(), size());
+    m_renderedFaces = 0;
+}
+
+int GLRenderTargetCube::tierFor(float pixels) const
+{
+    // Going down takes a fifth of slack, so a size near a tier's edge does not flip between two tiers.
+    int tier = m_tier;
+    while (tier > 0 && pixels > tierSize(tier))
+        --tier;
+    while (tier + 1 < m_tierCount && pixels <= 0.8f * tierSize(tier + 1))
+        ++tier;
+    return tier;
 }
 
 void GLRenderTargetCube::begin(int face)
 {
-    GLBUFFERS_ASSERT_OPENGL("GLRenderTargetCube::begin",
-        glFramebufferTexture2DEXT && glFramebufferRenderbufferEXT, return)
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTargetCube::begin", glFramebufferTexture2DEXT, return)
 
+    touch();
+    m_face = face;
     m_fbo.setAsRenderTarget(true);
     glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
         GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_texture, 0);
-    glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, m_fbo.m_depthBuffer);
+}
+
+void GLRenderTargetCube::beginLayered()
+{
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTargetCube::beginLayered", glFramebufferTextureEXT, return)
+
+    touch();
+    m_face = -1;
+    m_fbo.setAsRenderTarget(true, true);
+    glFramebufferTextureEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, m_texture, 0);
+}
+
+void GLRenderTargetCube::copyFrom(GLRenderTargetCube *source, int face)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTargetCube::copyFrom", glBlitFramebufferEXT && glFramebufferTexture2DEXT, return)
+
+    if (source->size() != size()) {
+        qWarning("GLRenderTargetCube::copyFrom: The cube maps differ in size. (%d != %d)", source->size(), size());
+        return;
+    }
+
+    // Outside begin()/end() neither frame buffer object has a depth buffer
+    // attached, and the color attachments are set again by the next begin().
+    touch();
+    glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, source->m_fbo.m_fbo);
+    glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, m_fbo.m_fbo);
+    for (int f = (face < 0 ? 0 : face); f < (face < 0 ? 6 : face + 1); ++f) {
+        glFramebufferTexture2DEXT(GL_READ_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, source->m_texture, 0);
+        glFramebufferTexture2DEXT(GL_DRAW_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, m_texture, 0);
+        glBlitFramebufferEXT(0, 0, size(), size(), 0, 0, size(), size(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+}
+
+bool GLRenderTargetCube::copyScaled(GLTextureCube *source)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTargetCube::copyScaled", glBlitFramebufferEXT && glFramebufferTexture2DEXT
+        && glGenFramebuffersEXT && glDeleteFramebuffersEXT && glCheckFramebufferStatusEXT, return false)
+
+    // 'source' has no frame buffer object of its own, it is read through a temporary one.
+    touch();
+    GLuint readFbo = 0;
+    glGenFramebuffersEXT(1, &readFbo);
+    glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, readFbo);
+    glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, m_fbo.m_fbo);
+    bool complete = true;
+    for (int face = 0; face < 6 && complete; ++face) {
+        glFramebufferTexture2DEXT(GL_READ_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, source->m_texture, 0);
+        glFramebufferTexture2DEXT(GL_DRAW_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+            GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, m_texture, 0);
+        // compressed formats are not color-renderable, their frame buffer is incomplete
+        complete = glCheckFramebufferStatusEXT(GL_READ_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT
+            && glCheckFramebufferStatusEXT(GL_DRAW_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+        if (complete)
+            glBlitFramebufferEXT(0, 0, source->size(), source->size(), 0, 0, size(), size(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    glDeleteFramebuffersEXT(1, &readFbo);
+    if (!complete)
+        return false;
+    m_renderedFaces = 0;
+    updateMipmaps();
+    return true;
 }
 
 void GLRenderTargetCube::end()
 {
     m_fbo.setAsRenderTarget(false);
+
+    m_renderedFaces |= (m_face < 0 ? 0x3f : 1 << m_face);
+    if (m_renderedFaces == 0x3f) {
+        updateMipmaps();
+        m_renderedFaces = 0;
+    }
 }
 
 void GLRenderTargetCube::getViewMatrix(QMatrix4x4& mat, int face)
@@ -392,3 +1234,101 @@ void GLRenderTargetCube::getProjectionMatrix(QMatrix4x4& mat, float nearZ, float
     mat(2, 2) = (nearZ+farZ)/(nearZ-farZ);
     mat(2, 3) = 2.0f*nearZ*farZ/(nearZ-farZ);
 }
+
+//============================================================================//
+//                              GLRenderTarget3D                              //
+//============================================================================//
+
+GLRenderTarget3D::GLRenderTarget3D(int width, int height, int depth, int channels)
+    : GLTexture3D(width, height, depth, channels)
+    , m_fbo(width, height, 0)
+{
+}
+
+void GLRenderTarget3D::begin(int slice)
+{
+    GLBUFFERS_ASSERT_OPENGL("GLRenderTarget3D::begin", glFramebufferTexture3DEXT, return)
+
+    if (slice < 0 || slice >= m_depth) {
+        qWarning("GLRenderTarget3D::begin: 'slice' must be in the range [0, %d). (slice == %d)", m_depth, slice);
+        return;
+    }
+
+    m_fbo.setAsRenderTarget(true);
+    glFramebufferTexture3DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+        GL_TEXTURE_3D, m_texture, 0, slice);
+}
+
+void GLRenderTarget3D::end()
+{
+    m_fbo.setAsRenderTarget(false);
+}
+
+//============================================================================//
+//                            GLPixelUnpackBuffer                             //
+//============================================================================//
+
+GLPixelUnpackBuffer::GLPixelUnpackBuffer(int size, bool bufferObject)
+    : m_size(size)
+    , m_buffer(0)
+{
+    if (bufferObject && getGLExtensionFunctions().pixelBufferObjectSupported()) {
+        glGenBuffers(1, &m_buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size, 0, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        m_memory.resize(m_size);
+    }
+}
+
+GLPixelUnpackBuffer::~GLPixelUnpackBuffer()
+{
+    if (m_buffer)
+        glDeleteBuffers(1, &m_buffer);
+}
+
+void *GLPixelUnpackBuffer::lock()
+{
+    if (!m_buffer)
+        return m_memory.data();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    // Orphan the old storage so that a pending upload from it does not stall the map.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size, 0, GL_STREAM_DRAW);
+    void *buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!buffer) {
+        qWarning("GLPixelUnpackBuffer::lock: Failed to map the buffer object, using host memory instead.");
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        m_memory.resize(m_size);
+        return m_memory.data();
+    }
+    return buffer;
+}
+
+void GLPixelUnpackBuffer::unlock()
+{
+    if (!m_buffer)
+        return;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+const void *GLPixelUnpackBuffer::bind()
+{
+    if (!m_buffer)
+        return m_memory.constData();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_buffer);
+    return BUFFER_OFFSET(0);
+}
+
+void GLPixelUnpackBuffer::unbind()
+{
+    if (m_buffer)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
@@ -64,78 +64,372 @@ public:
     virtual void bind() = 0;
     virtual void unbind() = 0;
     virtual bool failed() const {return m_failed;}
+    // Opt-in mip chain. Enabling builds the levels below 0 on the GPU from
+    // level 0 and switches minification to trilinear. Disabling goes back to
+    // GL_LINEAR and leaves the levels unused. Returns false if the context
+    // cannot generate mipmaps.
+    bool setMipmapped(bool enabled);
+    bool isMipmapped() const {return m_mipmapped;}
+    // Rebuilds the chain after level 0 has changed. Does nothing without one.
+    void updateMipmaps();
+    // Video memory of all levels, as accounted by TextureResidency.
+    qint64 byteCount() const {return m_byteCount;}
+    // TextureResidency::clock() at the last bind().
+    quint64 lastBound() const {return m_lastBound;}
 protected:
+    virtual GLenum target() const = 0;
+    // Records that level 0 now takes 'bytes', all faces or layers together.
+    void setLevelBytes(qint64 bytes);
+    // Marks the texture as the most recently bound one. bind() calls it.
+    void touch();
+    // Gives the texture storage for width x height x depth texels of
+    // 'internalFormat' (depth 1 for 2D textures and cube maps), with room for
+    // a mip chain if mipmapped, unless it has that already. The storage is
+    // immutable where glTexStorage is available, so later loads of the same
+    // size only update it with glTexSubImage*. Leaves the texture bound.
+    // Returns true if the storage is new and its contents undefined.
+    bool allocate(GLenum internalFormat, int width, int height, int depth = 1);
+    // For storage the caller respecifies itself with glTexImage* or
+    // glCompressedTexImage*: releaseStorage() before, setStorage() after.
+    // Immutable storage cannot be respecified, so releaseStorage() swaps it
+    // for a new texture object with the same parameters.
+    void releaseStorage();
+    void setStorage(GLenum internalFormat, int width, int height, int depth = 1);
+    // Level 0 of 'image' (target() or a cube face) as stored: compressed
+    // blocks with 'format' set to the compressed format, or BGRA pixels with
+    // 'format' set to GL_BGRA.
+    QByteArray readImage(GLenum image, GLenum *format) const;
     GLuint m_texture;
     bool m_failed;
+    bool m_mipmapped;
+private:
+    void updateByteCount();
+    void recordStorage(GLenum internalFormat, int width, int height, int depth, int levels, bool immutable);
+    void growMipChain();
+    GLenum m_storageFormat;     // 0 while there is no storage
+    int m_storageWidth, m_storageHeight, m_storageDepth;
+    int m_storageLevels;
+    bool m_immutable;
+    qint64 m_levelBytes;
+    qint64 m_byteCount;
+    quint64 m_lastBound;
 };
 
 class GLTexture2D : public GLTexture
 {
 public:
-    GLTexture2D(int width, int height);
+    // Without 'allocateStorage' only the parameters are set, for callers whose
+    // first load respecifies the storage anyway (compressed data).
+    GLTexture2D(int width, int height, bool allocateStorage = true);
     explicit GLTexture2D(const QString& fileName, int width = 0, int height = 0);
-    void load(int width, int height, QRgb *data);
+    // For images decoded elsewhere, e.g. on a loader thread.
+    explicit GLTexture2D(const QImage& image, int width = 0, int height = 0);
+    // Storage of the same size is reused and only updated. While a
+    // GLPixelUnpackBuffer is bound, 'data' is the value its bind() returned.
+    // A compressed 'internalFormat' has the driver compress 'data' on upload.
+    void load(int width, int height, const QRgb *data, GLenum internalFormat = 4);
+    // 'data' holds 'byteCount' bytes already compressed in 'format'.
+    void loadCompressed(int width, int height, GLenum format, const void *data, int byteCount);
+    // See GLTexture::readImage().
+    QByteArray imageData(GLenum *format) const {return readImage(GL_TEXTURE_2D, format);}
     virtual void bind() Q_DECL_OVERRIDE;
     virtual void unbind() Q_DECL_OVERRIDE;
+protected:
+    virtual GLenum target() const Q_DECL_OVERRIDE {return GL_TEXTURE_2D;}
+private:
+    void loadImage(QImage image, int width, int height);
 };
 
 class GLTexture3D : public GLTexture
 {
 public:
-    GLTexture3D(int width, int height, int depth);
+    // 'channels' is 1 (GL_R8), 2 (GL_RG8) or 4 (GL_RGBA8 from BGRA data). Without
+    // texture_rg support one and two channels are widened to four, see channels().
+    GLTexture3D(int width, int height, int depth, int channels = 4);
     // TODO: Implement function below
     //GLTexture3D(const QString& fileName, int width = 0, int height = 0);
-    void load(int width, int height, int depth, QRgb *data);
+    // 'data' holds channels() bytes per texel. Storage of the same size is
+    // reused and only updated. While a GLPixelUnpackBuffer is bound, 'data'
+    // is the value its bind() returned.
+    void load(int width, int height, int depth, const void *data);
+    // Replaces slices [zOffset, zOffset + depth). While a GLPixelUnpackBuffer
+    // is bound, 'data' is the value its bind() returned.
+    void loadSlab(int zOffset, int depth, const void *data);
+    // Reads the whole volume back into 'data', channels() bytes per texel.
+    void read(void *data);
+    int channels() const {return m_channels;}
+    // What channels() will be for a texture created with 'channels'.
+    static int storedChannels(int channels);
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+    int depth() const {return m_depth;}
+    virtual void bind() Q_DECL_OVERRIDE;
+    virtual void unbind() Q_DECL_OVERRIDE;
+protected:
+    virtual GLenum target() const Q_DECL_OVERRIDE {return GL_TEXTURE_3D;}
+    int m_width, m_height, m_depth;
+private:
+    int m_channels;
+    GLenum m_internalFormat;
+    GLenum m_format;
+};
+
+// All layers share one size and are selected in the shader, so switching
+// between them needs no rebinding. Needs GL_EXT_texture_array, see isSupported().
+class GLTexture2DArray : public GLTexture
+{
+public:
+    GLTexture2DArray(int width, int height, int layers);
+    // Replaces one layer. 0 <= layer < layers()
+    void load(int layer, const QRgb *data);
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+    int layers() const {return m_layers;}
+    // Array textures are only sampled by shaders, so bind() and unbind()
+    // leave the fixed-function texture enables alone.
     virtual void bind() Q_DECL_OVERRIDE;
     virtual void unbind() Q_DECL_OVERRIDE;
+    static bool isSupported();
+protected:
+    virtual GLenum target() const Q_DECL_OVERRIDE {return GL_TEXTURE_2D_ARRAY_EXT;}
+private:
+    int m_width, m_height, m_layers;
 };
 
 class GLTextureCube : public GLTexture
 {
 public:
-    GLTextureCube(int size);
+    // See GLTexture2D(int, int, bool).
+    GLTextureCube(int size, bool allocateStorage = true);
+    // The faces are decoded concurrently on the shared WorkStealingPool and
+    // uploaded in order, each as soon as it and the ones before it are ready.
     explicit GLTextureCube(const QStringList& fileNames, int size = 0);
-    void load(int size, int face, QRgb *data);
+    // Storage of the same size is reused and only updated; all faces share
+    // one size. While a GLPixelUnpackBuffer is bound, 'data' is the value its
+    // bind() returned. A compressed 'internalFormat' has the driver compress
+    // 'data' on upload.
+    void load(int size, int face, const QRgb *data, GLenum internalFormat = 4);
+    // 'data' holds 'byteCount' bytes already compressed in 'format'.
+    void loadCompressed(int size, int face, GLenum format, const void *data, int byteCount);
+    // See GLTexture::readImage().
+    QByteArray imageData(int face, GLenum *format) const {return readImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, format);}
+    // Reads a face as ARGB32, scaled to size x size unless 'size' <= 0. Makes
+    // no OpenGL calls, so it can run on any thread.
+    static QImage loadFace(const QString &fileName, int size);
+    int size() const {return m_size;}
     virtual void bind() Q_DECL_OVERRIDE;
     virtual void unbind() Q_DECL_OVERRIDE;
+protected:
+    virtual GLenum target() const Q_DECL_OVERRIDE {return GL_TEXTURE_CUBE_MAP;}
+    // New uncompressed storage of 'size', contents undefined.
+    void resize(int size);
+private:
+    friend class GLRenderTargetCube;
+    int m_size;
+};
+
+// Depth renderbuffers shared by the frame buffer objects. Rendering to the
+// targets never overlaps and nothing reads their depth afterwards, so a
+// target only borrows a buffer of its size and format between begin() and
+// end(), and all targets of one size end up sharing a single buffer. The
+// buffers of a size are kept for as long as a target of that size exists.
+// Layered targets borrow a depth cube map of the size instead.
+class GLDepthBufferPool
+{
+public:
+    static GLDepthBufferPool *instance();
+
+    // A renderbuffer, or a cube map texture if 'layered'.
+    GLuint acquire(int width, int height, GLenum format, bool layered = false);
+    void release(GLuint buffer, bool layered = false);
+
+    int bufferCount() const;
+    qint64 bytes() const;
+    // What the targets would take with a depth buffer each, minus bytes().
+    qint64 savedBytes() const;
+private:
+    friend class GLFrameBufferObject;
+
+    struct Key
+    {
+        int width, height;
+        GLenum format;
+        bool operator==(const Key &other) const
+            {return width == other.width && height == other.height && format == other.format;}
+        friend uint qHash(const Key &key) {return qHash(key.width) ^ qHash(key.height << 16) ^ qHash(key.format);}
+    };
+    struct Entry
+    {
+        Entry() : users(0) {borrowed[0] = borrowed[1] = 0;}
+        int users;
+        int borrowed[2];            // renderbuffers, cube maps
+        QVector<GLuint> free[2];
+    };
+    static qint64 bufferBytes(const Key &key, bool layered)  // 24 bit depth, padded
+        {return qint64(key.width) * key.height * 4 * (layered ? 6 : 1);}
+    static quint64 borrowedKey(GLuint buffer, bool layered) {return quint64(buffer) | (quint64(layered) << 32);}
+
+    GLDepthBufferPool() {}
+    void addUser(int width, int height, GLenum format);
+    void removeUser(int width, int height, GLenum format);
+    void deleteBuffers(const Key &key, Entry &entry);
+
+    QHash<Key, Entry> m_entries;
+    QHash<quint64, Key> m_borrowed;
+
+    Q_DISABLE_COPY(GLDepthBufferPool)
 };
 
 class GLFrameBufferObject
 {
 public:
     friend class GLRenderTargetCube;
-    // friend class GLRenderTarget2D;
+    friend class GLRenderTarget3D;
+    friend class GLRenderTarget2D;
 
-    GLFrameBufferObject(int width, int height);
+    // 'depthFormat' 0 means no depth attachment.
+    GLFrameBufferObject(int width, int height, GLenum depthFormat = GL_DEPTH_COMPONENT);
     virtual ~GLFrameBufferObject();
     bool isComplete();
     virtual bool failed() const {return m_failed;}
 protected:
-    void setAsRenderTarget(bool state = true);
+    // Also borrows the depth buffer from GLDepthBufferPool and attaches it,
+    // and detaches and returns it again. A 'layered' target gets a depth
+    // cube map attached whole, for a color cube map attached whole.
+    void setAsRenderTarget(bool state = true, bool layered = false);
+    void detachDepthBuffer();
+    // Renders width x height from now on. Call outside setAsRenderTarget().
+    void resize(int width, int height);
     GLuint m_fbo;
     GLuint m_depthBuffer;
+    GLenum m_depthFormat;
+    bool m_depthLayered;
     int m_width, m_height;
     bool m_failed;
 };
 
-// TODO: Define and implement class below
-//class GLRenderTarget2D : public GLTexture2D
+// Renders into a 2D texture, with a depth buffer from GLDepthBufferPool.
+// With 'samples' above one, and where the context supports it, rendering
+// goes to multisampled color and depth buffers of the target's own instead,
+// and end() resolves them into the texture.
+class GLRenderTarget2D : public GLTexture2D
+{
+public:
+    GLRenderTarget2D(int width, int height, int samples = 0);
+    virtual ~GLRenderTarget2D();
+    // begin rendering, with the viewport covering the whole target
+    void begin();
+    // end rendering, resolving the samples and rebuilding a mip chain
+    void end();
+    // whether the target set up by begin() can be rendered to
+    bool isComplete() {return m_fbo.isComplete();}
+    int width() const {return m_width;}
+    int height() const {return m_height;}
+    // Samples per pixel while rendering, 0 if not multisampled.
+    int samples() const {return m_samples;}
+    // The texture read back, top row first. Call outside begin()/end().
+    QImage toImage();
+    virtual bool failed() const Q_DECL_OVERRIDE {return m_failed || m_fbo.failed();}
+    // Most samples the context allows, 0 without multisampled render targets.
+    static int maxSamples();
+private:
+    int m_width, m_height;
+    int m_samples;
+    GLFrameBufferObject m_fbo;      // the texture, and pooled depth if not multisampled
+    GLuint m_sampleFbo;             // multisampled color and depth, resolved into m_fbo
+    GLuint m_sampleBuffers[2];
+};
+
+// Renders into the slices of a 3D texture, one at a time.
+class GLRenderTarget3D : public GLTexture3D
+{
+public:
+    GLRenderTarget3D(int width, int height, int depth, int channels = 4);
+    // begin rendering to one of the volume's slices. 0 <= slice < depth
+    void begin(int slice);
+    // end rendering
+    void end();
+    // whether the slice set up by begin() can be rendered to
+    bool isComplete() {return m_fbo.isComplete();}
+    virtual bool failed() const Q_DECL_OVERRIDE {return m_failed || m_fbo.failed();}
+private:
+    GLFrameBufferObject m_fbo;
+};
 
 //
+// Renders into the faces of a cube map. The target has resolution tiers,
+// 'size' and each half of it down to 'minSize', and the owner moves it
+// between them to follow what the reflection needs on screen.
 class GLRenderTargetCube : public GLTextureCube
 {
 public:
-    GLRenderTargetCube(int size);
+    // One tier of 'size' if 'minSize' is 0. Starts at the largest tier.
+    explicit GLRenderTargetCube(int size, int minSize = 0);
+    int tierCount() const {return m_tierCount;}
+    int tier() const {return m_tier;}
+    // Face size of 'tier', 0 being the largest.
+    int tierSize(int tier) const {return m_maxSize >> tier;}
+    // Reallocates the faces at the size of 'tier'. The contents are undefined
+    // until all faces have been rendered again. Call outside begin()/end().
+    void setTier(int tier);
+    // The tier for a face size of 'pixels': the current one while it is
+    // large enough and not much more than that, otherwise the smallest one
+    // at least 'pixels' large.
+    int tierFor(float pixels) const;
     // begin rendering to one of the cube's faces. 0 <= face < 6
     void begin(int face);
-    // end rendering
+    // begin rendering to all six faces at once, a geometry shader sends each
+    // primitive to its faces through gl_Layer
+    void beginLayered();
+    // end rendering. A mip chain is rebuilt once all six faces have been rendered again.
     void end();
+    // whether the target set up by begin() or beginLayered() can be rendered to
+    bool isComplete() {return m_fbo.isComplete();}
+    static bool isLayeredSupported() {return getGLExtensionFunctions().layeredRenderingSupported();}
+    // Copies face 'face' of 'source', or all six faces if -1, into the same
+    // faces here. Both cube maps must have the same size. Call outside
+    // begin()/end(); the copied faces still count as unrendered.
+    void copyFrom(GLRenderTargetCube *source, int face = -1);
+    static bool isCopySupported() {return getGLExtensionFunctions().framebufferBlitSupported();}
+    // Fills all faces from any cube map, scaled with linear filtering, and
+    // rebuilds the mip chain. Call outside begin()/end(). Returns false if
+    // 'source' cannot be read through a frame buffer object, e.g. because it
+    // is compressed; the faces are undefined then.
+    bool copyScaled(GLTextureCube *source);
     virtual bool failed() const Q_DECL_OVERRIDE {return m_failed || m_fbo.failed();}
 
     static void getViewMatrix(QMatrix4x4& mat, int face);
     static void getProjectionMatrix(QMatrix4x4& mat, float nearZ, float farZ);
 private:
     GLFrameBufferObject m_fbo;
+    int m_maxSize;
+    int m_tierCount;
+    int m_tier;
+    int m_face;             // face set up by begin(), -1 after beginLayered()
+    int m_renderedFaces;    // bit per face rendered since the last mip rebuild
+};
+
+// Staging memory for texture uploads: a pixel unpack buffer object when the
+// context supports them and 'bufferObject' is set, so the driver can copy it
+// to the texture asynchronously, and plain host memory otherwise.
+class GLPixelUnpackBuffer
+{
+public:
+    explicit GLPixelUnpackBuffer(int size, bool bufferObject = true);
+    ~GLPixelUnpackBuffer();
+    // Returns the memory to fill, discarding the previous contents. Any thread
+    // may write to it until unlock(), which must be called on the GL thread.
+    void *lock();
+    void unlock();
+    // Binds the buffer for glTexSubImage*() and returns the pointer to pass as its data.
+    const void *bind();
+    void unbind();
+    int size() const {return m_size;}
+    bool isBufferObject() const {return m_buffer != 0;}
+private:
+    int m_size;
+    GLuint m_buffer;
+    QByteArray m_memory;
 };
 
 struct VertexDescription
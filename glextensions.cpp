@@ -52,6 +52,7 @@ bool GLExtensionFunctions::resolve(const QGLContext *context)
 
     RESOLVE_GL_FUNC(ActiveTexture)
     RESOLVE_GL_FUNC(TexImage3D)
+    RESOLVE_GL_FUNC(TexSubImage3D)
 
     RESOLVE_GL_FUNC(GenBuffers)
     RESOLVE_GL_FUNC(BindBuffer)
@@ -60,9 +61,79 @@ bool GLExtensionFunctions::resolve(const QGLContext *context)
     RESOLVE_GL_FUNC(MapBuffer)
     RESOLVE_GL_FUNC(UnmapBuffer)
 
+    // Optional, only the GPU noise pass renders into 3D textures.
+    FramebufferTexture3DEXT = (_glFramebufferTexture3DEXT) context->getProcAddress(QLatin1String("glFramebufferTexture3DEXT"));
+    // Optional, dynamic cube maps are rendered one face at a time without it.
+    FramebufferTextureEXT = (_glFramebufferTextureEXT) context->getProcAddress(QLatin1String("glFramebufferTexture"));
+    if (!FramebufferTextureEXT)
+        FramebufferTextureEXT = (_glFramebufferTextureEXT) context->getProcAddress(QLatin1String("glFramebufferTextureEXT"));
+    // Optional, offscreen render targets are not antialiased without them.
+    RenderbufferStorageMultisampleEXT = (_glRenderbufferStorageMultisampleEXT) context->getProcAddress(QLatin1String("glRenderbufferStorageMultisampleEXT"));
+    if (!RenderbufferStorageMultisampleEXT)
+        RenderbufferStorageMultisampleEXT = (_glRenderbufferStorageMultisampleEXT) context->getProcAddress(QLatin1String("glRenderbufferStorageMultisample"));
+    BlitFramebufferEXT = (_glBlitFramebufferEXT) context->getProcAddress(QLatin1String("glBlitFramebufferEXT"));
+    if (!BlitFramebufferEXT)
+        BlitFramebufferEXT = (_glBlitFramebufferEXT) context->getProcAddress(QLatin1String("glBlitFramebuffer"));
+    // Optional, textures stay single level without it.
+    GenerateMipmapEXT = (_glGenerateMipmapEXT) context->getProcAddress(QLatin1String("glGenerateMipmapEXT"));
+    // Optional, textures are cached uncompressed without them.
+    CompressedTexImage2D = (_glCompressedTexImage2D) context->getProcAddress(QLatin1String("glCompressedTexImage2D"));
+    GetCompressedTexImage = (_glGetCompressedTexImage) context->getProcAddress(QLatin1String("glGetCompressedTexImage"));
+    // Optional, textures get mutable storage without them.
+    TexStorage2D = (_glTexStorage2D) context->getProcAddress(QLatin1String("glTexStorage2D"));
+    if (!TexStorage2D)
+        TexStorage2D = (_glTexStorage2D) context->getProcAddress(QLatin1String("glTexStorage2DEXT"));
+    TexStorage3D = (_glTexStorage3D) context->getProcAddress(QLatin1String("glTexStorage3D"));
+    if (!TexStorage3D)
+        TexStorage3D = (_glTexStorage3D) context->getProcAddress(QLatin1String("glTexStorage3DEXT"));
+    // Optional, only used for measurements.
+    GenQueries = (_glGenQueries) context->getProcAddress(QLatin1String("glGenQueries"));
+    DeleteQueries = (_glDeleteQueries) context->getProcAddress(QLatin1String("glDeleteQueries"));
+    BeginQuery = (_glBeginQuery) context->getProcAddress(QLatin1String("glBeginQuery"));
+    EndQuery = (_glEndQuery) context->getProcAddress(QLatin1String("glEndQuery"));
+    GetQueryObjectuiv = (_glGetQueryObjectuiv) context->getProcAddress(QLatin1String("glGetQueryObjectuiv"));
+
+    textureRG = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+            || hasExtension("GL_ARB_texture_rg");
+    textureFloat = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+            || hasExtension("GL_ARB_texture_float");
+    pixelBufferObject = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_2_1)
+            || hasExtension("GL_ARB_pixel_buffer_object");
+    textureArray = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+            || hasExtension("GL_EXT_texture_array");
+    textureCompressionS3TC = hasExtension("GL_EXT_texture_compression_s3tc");
+    textureStorage = hasExtension("GL_ARB_texture_storage") || hasExtension("GL_EXT_texture_storage");
+    timerQuery = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_3)
+            || hasExtension("GL_ARB_timer_query") || hasExtension("GL_EXT_timer_query");
+    framebufferMultisample = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+            || (hasExtension("GL_EXT_framebuffer_multisample") && hasExtension("GL_EXT_framebuffer_blit"));
+    framebufferBlit = (QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+            || hasExtension("GL_EXT_framebuffer_blit");
+    // The geometry shader is written against GL_EXT_geometry_shader4, and a
+    // layered frame buffer needs a depth cube map, which came with GL 3.0.
+    layeredRendering = (hasExtension("GL_EXT_geometry_shader4") || hasExtension("GL_ARB_geometry_shader4"))
+            && ((QGLFormat::openGLVersionFlags() & QGLFormat::OpenGL_Version_3_0)
+                || hasExtension("GL_EXT_gpu_shader4"));
+
     return ok;
 }
 
+bool GLExtensionFunctions::hasExtension(const char *name)
+{
+    const char *p = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    const int length = int(strlen(name));
+
+    while (p && *p) {
+        if (strncmp(p, name, length) == 0 && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+        while ((*p != ' ') && (*p != '\0'))
+            ++p;
+        if (*p == ' ')
+            ++p;
+    }
+    return false;
+}
+
 bool GLExtensionFunctions::fboSupported() {
     return GenFramebuffersEXT
             && GenRenderbuffersEXT
@@ -79,6 +150,7 @@ bool GLExtensionFunctions::fboSupported() {
 bool GLExtensionFunctions::openGL15Supported() {
     return ActiveTexture
             && TexImage3D
+            && TexSubImage3D
             && GenBuffers
             && BindBuffer
             && BufferData
@@ -87,4 +159,45 @@ bool GLExtensionFunctions::openGL15Supported() {
             && UnmapBuffer;
 }
 
+bool GLExtensionFunctions::occlusionQuerySupported() {
+    return GenQueries
+            && DeleteQueries
+            && BeginQuery
+            && EndQuery
+            && GetQueryObjectuiv;
+}
+
+bool GLExtensionFunctions::timerQuerySupported() {
+    return timerQuery && occlusionQuerySupported();
+}
+
+bool GLExtensionFunctions::textureCompressionSupported() const {
+    return textureCompressionS3TC
+            && CompressedTexImage2D
+            && GetCompressedTexImage;
+}
+
+bool GLExtensionFunctions::textureStorageSupported() const {
+    return textureStorage
+            && TexStorage2D
+            && TexStorage3D;
+}
+
+bool GLExtensionFunctions::layeredRenderingSupported() const {
+    return layeredRendering
+            && FramebufferTextureEXT
+            && QGLShader::hasOpenGLShaders(QGLShader::Geometry);
+}
+
+bool GLExtensionFunctions::framebufferMultisampleSupported() const {
+    return framebufferMultisample
+            && RenderbufferStorageMultisampleEXT
+            && BlitFramebufferEXT;
+}
+
+bool GLExtensionFunctions::framebufferBlitSupported() const {
+    return framebufferBlit
+            && BlitFramebufferEXT;
+}
+
 #undef RESOLVE_GL_FUNC
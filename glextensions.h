@@ -47,11 +47,27 @@ glDeleteFramebuffersEXT
 glDeleteRenderbuffersEXT
 glBindFramebufferEXT
 glFramebufferTexture2DEXT
+glFramebufferTexture3DEXT
+glFramebufferTextureEXT
 glFramebufferRenderbufferEXT
 glCheckFramebufferStatusEXT
+glRenderbufferStorageMultisampleEXT
+glBlitFramebufferEXT
 
 glActiveTexture
 glTexImage3D
+glTexSubImage3D
+glGenerateMipmapEXT
+glCompressedTexImage2D
+glGetCompressedTexImage
+glTexStorage2D
+glTexStorage3D
+
+glGenQueries
+glDeleteQueries
+glBeginQuery
+glEndQuery
+glGetQueryObjectuiv
 
 glGenBuffers
 glBindBuffer
@@ -106,6 +122,48 @@ typedef ptrdiff_t GLsizeiptrARB;
 #define GL_ELEMENT_ARRAY_BUFFER 0x8893
 #define GL_READ_WRITE 0x88BA
 #define GL_STATIC_DRAW 0x88E4
+#define GL_STREAM_DRAW 0x88E0
+#define GL_WRITE_ONLY 0x88B9
+#define GL_SAMPLES_PASSED 0x8914
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef GL_ARB_timer_query
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+#ifndef GL_VERSION_2_1
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+
+#ifndef GL_EXT_texture_array
+#define GL_TEXTURE_2D_ARRAY_EXT 0x8C1A
+#endif
+
+#ifndef GL_VERSION_1_4
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+#ifndef GL_VERSION_1_3
+#define GL_TEXTURE_COMPRESSED_IMAGE_SIZE 0x86A0
+#define GL_TEXTURE_COMPRESSED 0x86A1
+#endif
+
+#ifndef GL_EXT_texture_compression_s3tc
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_ARB_texture_rg
+#define GL_RED 0x1903
+#define GL_RG 0x8227
+#define GL_R8 0x8229
+#define GL_RG8 0x822B
+#endif
+
+#ifndef GL_ARB_texture_float
+#define GL_RGBA32F_ARB 0x8814
 #endif
 
 #ifndef GL_EXT_framebuffer_object
@@ -116,6 +174,15 @@ typedef ptrdiff_t GLsizeiptrARB;
 #define GL_DEPTH_ATTACHMENT_EXT 0x8D00
 #endif
 
+#ifndef GL_EXT_framebuffer_blit
+#define GL_READ_FRAMEBUFFER_EXT 0x8CA8
+#define GL_DRAW_FRAMEBUFFER_EXT 0x8CA9
+#endif
+
+#ifndef GL_EXT_framebuffer_multisample
+#define GL_MAX_SAMPLES_EXT 0x8D57
+#endif
+
 typedef void (APIENTRY *_glGenFramebuffersEXT) (GLsizei, GLuint *);
 typedef void (APIENTRY *_glGenRenderbuffersEXT) (GLsizei, GLuint *);
 typedef void (APIENTRY *_glBindRenderbufferEXT) (GLenum, GLuint);
@@ -124,11 +191,27 @@ typedef void (APIENTRY *_glDeleteFramebuffersEXT) (GLsizei, const GLuint*);
 typedef void (APIENTRY *_glDeleteRenderbuffersEXT) (GLsizei, const GLuint*);
 typedef void (APIENTRY *_glBindFramebufferEXT) (GLenum, GLuint);
 typedef void (APIENTRY *_glFramebufferTexture2DEXT) (GLenum, GLenum, GLenum, GLuint, GLint);
+typedef void (APIENTRY *_glFramebufferTexture3DEXT) (GLenum, GLenum, GLenum, GLuint, GLint, GLint);
+typedef void (APIENTRY *_glFramebufferTextureEXT) (GLenum, GLenum, GLuint, GLint);
 typedef void (APIENTRY *_glFramebufferRenderbufferEXT) (GLenum, GLenum, GLenum, GLuint);
 typedef GLenum (APIENTRY *_glCheckFramebufferStatusEXT) (GLenum);
+typedef void (APIENTRY *_glRenderbufferStorageMultisampleEXT) (GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+typedef void (APIENTRY *_glBlitFramebufferEXT) (GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum);
 
 typedef void (APIENTRY *_glActiveTexture) (GLenum);
 typedef void (APIENTRY *_glTexImage3D) (GLenum, GLint, GLenum, GLsizei, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid *);
+typedef void (APIENTRY *_glTexSubImage3D) (GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const GLvoid *);
+typedef void (APIENTRY *_glGenerateMipmapEXT) (GLenum);
+typedef void (APIENTRY *_glCompressedTexImage2D) (GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const GLvoid *);
+typedef void (APIENTRY *_glGetCompressedTexImage) (GLenum, GLint, GLvoid *);
+typedef void (APIENTRY *_glTexStorage2D) (GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+typedef void (APIENTRY *_glTexStorage3D) (GLenum, GLsizei, GLenum, GLsizei, GLsizei, GLsizei);
+
+typedef void (APIENTRY *_glGenQueries) (GLsizei, GLuint *);
+typedef void (APIENTRY *_glDeleteQueries) (GLsizei, const GLuint *);
+typedef void (APIENTRY *_glBeginQuery) (GLenum, GLuint);
+typedef void (APIENTRY *_glEndQuery) (GLenum);
+typedef void (APIENTRY *_glGetQueryObjectuiv) (GLuint, GLenum, GLuint *);
 
 typedef void (APIENTRY *_glGenBuffers) (GLsizei, GLuint *);
 typedef void (APIENTRY *_glBindBuffer) (GLenum, GLuint);
@@ -143,6 +226,19 @@ struct GLExtensionFunctions
 
     bool fboSupported();
     bool openGL15Supported(); // the rest: multi-texture, 3D-texture, vertex buffer objects
+    bool textureRGSupported() const {return textureRG;} // GL_R8 and GL_RG8 textures
+    bool textureFloatSupported() const {return textureFloat;} // GL_RGBA32F_ARB textures
+    bool pixelBufferObjectSupported() const {return pixelBufferObject;} // GL_PIXEL_UNPACK_BUFFER
+    bool textureArraySupported() const {return textureArray;} // GL_TEXTURE_2D_ARRAY_EXT textures
+    bool textureCompressionSupported() const; // S3TC textures, compressed by the driver and read back
+    bool textureStorageSupported() const; // immutable storage allocated with glTexStorage*
+    bool layeredRenderingSupported() const; // geometry shaders writing gl_Layer of a cube map attached whole
+    bool framebufferMultisampleSupported() const; // multisampled renderbuffers, resolved with glBlitFramebufferEXT
+    bool framebufferBlitSupported() const; // glBlitFramebufferEXT between separate read and draw frame buffers
+    bool occlusionQuerySupported(); // GL_SAMPLES_PASSED queries
+    bool timerQuerySupported(); // GL_TIME_ELAPSED queries
+
+    static bool hasExtension(const char *name);
 
     _glGenFramebuffersEXT GenFramebuffersEXT;
     _glGenRenderbuffersEXT GenRenderbuffersEXT;
@@ -152,11 +248,27 @@ struct GLExtensionFunctions
     _glDeleteRenderbuffersEXT DeleteRenderbuffersEXT;
     _glBindFramebufferEXT BindFramebufferEXT;
     _glFramebufferTexture2DEXT FramebufferTexture2DEXT;
+    _glFramebufferTexture3DEXT FramebufferTexture3DEXT;
+    _glFramebufferTextureEXT FramebufferTextureEXT;
     _glFramebufferRenderbufferEXT FramebufferRenderbufferEXT;
     _glCheckFramebufferStatusEXT CheckFramebufferStatusEXT;
+    _glRenderbufferStorageMultisampleEXT RenderbufferStorageMultisampleEXT;
+    _glBlitFramebufferEXT BlitFramebufferEXT;
 
     _glActiveTexture ActiveTexture;
     _glTexImage3D TexImage3D;
+    _glTexSubImage3D TexSubImage3D;
+    _glGenerateMipmapEXT GenerateMipmapEXT;
+    _glCompressedTexImage2D CompressedTexImage2D;
+    _glGetCompressedTexImage GetCompressedTexImage;
+    _glTexStorage2D TexStorage2D;
+    _glTexStorage3D TexStorage3D;
+
+    _glGenQueries GenQueries;
+    _glDeleteQueries DeleteQueries;
+    _glBeginQuery BeginQuery;
+    _glEndQuery EndQuery;
+    _glGetQueryObjectuiv GetQueryObjectuiv;
 
     _glGenBuffers GenBuffers;
     _glBindBuffer BindBuffer;
@@ -164,6 +276,17 @@ struct GLExtensionFunctions
     _glDeleteBuffers DeleteBuffers;
     _glMapBuffer MapBuffer;
     _glUnmapBuffer UnmapBuffer;
+
+    bool textureRG;
+    bool textureFloat;
+    bool pixelBufferObject;
+    bool textureArray;
+    bool textureCompressionS3TC;
+    bool textureStorage;
+    bool layeredRendering;
+    bool framebufferMultisample;
+    bool framebufferBlit;
+    bool timerQuery;
 };
 
 inline GLExtensionFunctions &getGLExtensionFunctions()
@@ -180,11 +303,27 @@ inline GLExtensionFunctions &getGLExtensionFunctions()
 #define glDeleteRenderbuffersEXT getGLExtensionFunctions().DeleteRenderbuffersEXT
 #define glBindFramebufferEXT getGLExtensionFunctions().BindFramebufferEXT
 #define glFramebufferTexture2DEXT getGLExtensionFunctions().FramebufferTexture2DEXT
+#define glFramebufferTexture3DEXT getGLExtensionFunctions().FramebufferTexture3DEXT
+#define glFramebufferTextureEXT getGLExtensionFunctions().FramebufferTextureEXT
 #define glFramebufferRenderbufferEXT getGLExtensionFunctions().FramebufferRenderbufferEXT
 #define glCheckFramebufferStatusEXT getGLExtensionFunctions().CheckFramebufferStatusEXT
+#define glRenderbufferStorageMultisampleEXT getGLExtensionFunctions().RenderbufferStorageMultisampleEXT
+#define glBlitFramebufferEXT getGLExtensionFunctions().BlitFramebufferEXT
 
 #define glActiveTexture getGLExtensionFunctions().ActiveTexture
 #define glTexImage3D getGLExtensionFunctions().TexImage3D
+#define glTexSubImage3D getGLExtensionFunctions().TexSubImage3D
+#define glGenerateMipmapEXT getGLExtensionFunctions().GenerateMipmapEXT
+#define glCompressedTexImage2D getGLExtensionFunctions().CompressedTexImage2D
+#define glGetCompressedTexImage getGLExtensionFunctions().GetCompressedTexImage
+#define glTexStorage2D getGLExtensionFunctions().TexStorage2D
+#define glTexStorage3D getGLExtensionFunctions().TexStorage3D
+
+#define glGenQueries getGLExtensionFunctions().GenQueries
+#define glDeleteQueries getGLExtensionFunctions().DeleteQueries
+#define glBeginQuery getGLExtensionFunctions().BeginQuery
+#define glEndQuery getGLExtensionFunctions().EndQuery
+#define glGetQueryObjectuiv getGLExtensionFunctions().GetQueryObjectuiv
 
 #define glGenBuffers getGLExtensionFunctions().GenBuffers
 #define glBindBuffer getGLExtensionFunctions().BindBuffer
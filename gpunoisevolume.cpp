@@ -0,0 +1,261 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "gpunoisevolume.h"
+#include "noisevolume.h"
+
+#include "3rdparty/fbm.h"
+
+// noise3() from fbm.c, with the lattice tables in 'tables': xyz holds the
+// gradient and w the permutation entry, 2 * lattice + 2 texels wide. Every
+// channel is shifted the same way as in NoiseVolume: red by an eighth of the
+// volume in y, green in x, blue not at all and alpha in both.
+static const char noiseShaderText[] =
+    "uniform sampler2D tables;\n"
+    "uniform float tableSize;\n"
+    "uniform float lattice;\n"
+    "uniform float scale;\n"
+    "uniform float slice;\n"
+    "uniform float shift;\n"
+    "uniform bool fullColor;\n"
+    "\n"
+    "vec4 entry(float i)\n"
+    "{\n"
+    "    return texture2D(tables, vec2((i + 0.5) / tableSize, 0.5));\n"
+    "}\n"
+    "\n"
+    "float sCurve(float t)\n"
+    "{\n"
+    "    return t * t * (3.0 - 2.0 * t);\n"
+    "}\n"
+    "\n"
+    "float lerp(float t, float a, float b)\n"
+    "{\n"
+    "    return a + t * (b - a);\n"
+    "}\n"
+    "\n"
+    "float at3(vec4 q, float rx, float ry, float rz)\n"
+    "{\n"
+    "    return rx * q.x + ry * q.y + rz * q.z;\n"
+    "}\n"
+    "\n"
+    "float noise3(vec3 v)\n"
+    "{\n"
+    "    vec3 t = v + 4096.0;\n"
+    "    vec3 b0 = mod(floor(t), lattice);\n"
+    "    vec3 b1 = mod(b0 + 1.0, lattice);\n"
+    "    vec3 r0 = t - floor(t);\n"
+    "    vec3 r1 = r0 - 1.0;\n"
+    "\n"
+    "    float i = entry(b0.x).w;\n"
+    "    float j = entry(b1.x).w;\n"
+    "    float b00 = entry(i + b0.y).w;\n"
+    "    float b10 = entry(j + b0.y).w;\n"
+    "    float b01 = entry(i + b1.y).w;\n"
+    "    float b11 = entry(j + b1.y).w;\n"
+    "\n"
+    "    float sx = sCurve(r0.x);\n"
+    "    float sy = sCurve(r0.y);\n"
+    "    float sz = sCurve(r0.z);\n"
+    "\n"
+    "    float a = lerp(sx, at3(entry(b00 + b0.z), r0.x, r0.y, r0.z), at3(entry(b10 + b0.z), r1.x, r0.y, r0.z));\n"
+    "    float b = lerp(sx, at3(entry(b01 + b0.z), r0.x, r1.y, r0.z), at3(entry(b11 + b0.z), r1.x, r1.y, r0.z));\n"
+    "    float c = lerp(sy, a, b);\n"
+    "    a = lerp(sx, at3(entry(b00 + b1.z), r0.x, r0.y, r1.z), at3(entry(b10 + b1.z), r1.x, r0.y, r1.z));\n"
+    "    b = lerp(sx, at3(entry(b01 + b1.z), r0.x, r1.y, r1.z), at3(entry(b11 + b1.z), r1.x, r1.y, r1.z));\n"
+    "    float d = lerp(sy, a, b);\n"
+    "    return lerp(sz, c, d);\n"
+    "}\n"
+    "\n"
+    "float channel(vec2 texel)\n"
+    "{\n"
+    "    float v = noise3(vec3(texel * scale, slice * scale));\n"
+    "    return min(255.0, floor(128.0 * (v + 1.0))) / 255.0;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 texel = floor(gl_FragCoord.xy);\n"
+    "    gl_FragColor.r = channel(texel + vec2(0.0, shift));\n"
+    "    gl_FragColor.g = channel(texel + vec2(shift, 0.0));\n"
+    "    gl_FragColor.ba = vec2(0.0);\n"
+    "    if (fullColor) {\n"
+    "        gl_FragColor.b = channel(texel);\n"
+    "        gl_FragColor.a = channel(texel + vec2(shift, shift));\n"
+    "    }\n"
+    "}\n";
+
+//============================================================================//
+//                               GpuNoiseVolume                               //
+//============================================================================//
+
+GpuNoiseVolume::GpuNoiseVolume(int size, unsigned int seed, int lattice)
+    : m_size(size)
+    , m_seed(seed)
+    , m_lattice(lattice)
+    , m_elapsed(0)
+{
+}
+
+bool GpuNoiseVolume::isSupported()
+{
+    GLExtensionFunctions &functions = getGLExtensionFunctions();
+    return functions.fboSupported()
+            && functions.FramebufferTexture3DEXT
+            && functions.textureFloatSupported()
+            && QGLShaderProgram::hasOpenGLShaderPrograms();
+}
+
+bool GpuNoiseVolume::render(GLRenderTarget3D *target)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!isSupported() || target->failed()) {
+        qWarning("GpuNoiseVolume::render: The necessary OpenGL features are not available.");
+        return false;
+    }
+
+    NoiseContext *context = noise_context_create(m_seed, m_lattice);
+    if (!context) {
+        qWarning("GpuNoiseVolume::render: Invalid lattice size %d, must be a power of two.", m_lattice);
+        return false;
+    }
+
+    const int entries = 2 * m_lattice + 2;
+    const int *permutation = noise_context_permutation(context);
+    const float *gradients = noise_context_gradients(context);
+    QVector<GLfloat> tableData(4 * entries);
+    for (int i = 0; i < entries; ++i) {
+        tableData[4 * i + 0] = gradients[3 * i + 0];
+        tableData[4 * i + 1] = gradients[3 * i + 1];
+        tableData[4 * i + 2] = gradients[3 * i + 2];
+        tableData[4 * i + 3] = GLfloat(permutation[i]);
+    }
+    noise_context_destroy(context);
+
+    QGLShaderProgram program;
+    if (!program.addShaderFromSourceCode(QGLShader::Fragment, noiseShaderText) || !program.link()) {
+        qWarning() << "GpuNoiseVolume::render: Failed to build the noise shader:" << program.log();
+        return false;
+    }
+
+    GLuint tables = 0;
+    glGenTextures(1, &tables);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, tables);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, entries, 1, 0, GL_RGBA, GL_FLOAT, tableData.constData());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+    glPushAttrib(GL_ENABLE_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_LIGHTING);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    program.bind();
+    program.setUniformValue("tables", GLint(0));
+    program.setUniformValue("tableSize", GLfloat(entries));
+    program.setUniformValue("lattice", GLfloat(m_lattice));
+    program.setUniformValue("scale", GLfloat(m_lattice) / m_size);
+    program.setUniformValue("shift", GLfloat(m_size / 8));
+    program.setUniformValue("fullColor", GLint(target->channels() == 4));
+    const int sliceLocation = program.uniformLocation("slice");
+
+    bool complete = true;
+    for (int slice = 0; slice < m_size; ++slice) {
+        target->begin(slice);
+        if (slice == 0)
+            complete = target->isComplete();
+        if (complete) {
+            program.setUniformValue(sliceLocation, GLfloat(slice));
+            glBegin(GL_QUADS);
+            glVertex2f(-1.0f, -1.0f);
+            glVertex2f(1.0f, -1.0f);
+            glVertex2f(1.0f, 1.0f);
+            glVertex2f(-1.0f, 1.0f);
+            glEnd();
+        }
+        target->end();
+        if (!complete)
+            break;
+    }
+    program.release();
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glPopAttrib();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &tables);
+
+    if (!complete) {
+        qWarning("GpuNoiseVolume::render: The %d channel volume can not be rendered to.", target->channels());
+        return false;
+    }
+
+    glFinish();
+    m_elapsed = timer.elapsed();
+    return true;
+}
+
+int GpuNoiseVolume::compare(GLTexture3D *texture, const NoiseVolume &reference, qint64 *mismatches)
+{
+    if (mismatches)
+        *mismatches = 0;
+    if (texture->channels() != reference.channels() || !reference.data())
+        return -1;
+
+    QVector<uchar> data(int(reference.byteCount()));
+    texture->read(data.data());
+
+    int largest = 0;
+    const uchar *expected = reference.data();
+    for (int i = 0; i < data.size(); ++i) {
+        int difference = qAbs(int(data[i]) - int(expected[i]));
+        if (difference && mismatches)
+            ++*mismatches;
+        largest = qMax(largest, difference);
+    }
+    return largest;
+}
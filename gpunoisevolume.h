@@ -0,0 +1,77 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef GPUNOISEVOLUME_H
+#define GPUNOISEVOLUME_H
+
+#include "glbuffers.h"
+
+class NoiseVolume;
+
+// Renders the same volume as NoiseVolume on the GPU, one Z slice at a time
+// into a GLRenderTarget3D. The lattice tables of the seed go up as a small
+// float texture and a fragment shader evaluates noise3() for every texel, so
+// startup time no longer scales with the CPU.
+//
+// The GPU works in single precision without the CPU's evaluation order
+// guarantees, so a texel may differ from NoiseVolume's by up to Tolerance
+// steps of 1/255 per channel. Mesa's llvmpipe stays within one step, and
+// only a few channel values per million differ at all.
+class GpuNoiseVolume
+{
+public:
+    enum { Tolerance = 1 };
+
+    GpuNoiseVolume(int size, unsigned int seed = 1, int lattice = 0x20);
+
+    // True if the current context can run the pass: framebuffer objects with
+    // 3D texture attachments, float textures and GLSL.
+    static bool isSupported();
+    // Fills 'target', which must be size() texels along each axis.
+    bool render(GLRenderTarget3D *target);
+    // Reads 'texture' back and compares it with 'reference'. Returns the largest
+    // difference in steps of 1/255, or -1 if the two have different layouts.
+    // 'mismatches' receives the number of channel values that differ at all.
+    static int compare(GLTexture3D *texture, const NoiseVolume &reference, qint64 *mismatches = 0);
+
+    int size() const {return m_size;}
+    unsigned int seed() const {return m_seed;}
+    qint64 elapsed() const {return m_elapsed;} // render time in milliseconds
+private:
+    int m_size;
+    unsigned int m_seed;
+    int m_lattice;
+    qint64 m_elapsed;
+};
+
+#endif
@@ -35,6 +35,7 @@
 #include "glextensions.h"
 
 #include "scene.h"
+#include "resourceregistry.h"
 
 #include <QtWidgets>
 #include <QGLWidget>
@@ -103,6 +104,113 @@ int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
 
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Boxes");
+    parser.addHelpOption();
+    QCommandLineOption noiseSizeOption("noise-size",
+        "Edge length of the 3D noise texture, a power of two (default 128).", "size", "128");
+    QCommandLineOption noiseSeedOption("noise-seed",
+        "Seed of the noise lattice (default 1).", "seed", "1");
+    QCommandLineOption noCacheOption("no-cache",
+        "Always regenerate resources instead of reusing them from the cache.");
+    QCommandLineOption cacheDirOption("cache-dir",
+        "Directory of the resource cache (default: the user's cache location).", "directory");
+    QCommandLineOption gpuNoiseOption("gpu-noise",
+        "Render the noise texture on the GPU instead of generating it on the CPU.");
+    QCommandLineOption verifyGpuNoiseOption("verify-gpu-noise",
+        "With --gpu-noise, also generate the noise on the CPU and report how much they differ.");
+    QCommandLineOption progressiveOption("progressive",
+        "Show the first frame with placeholder resources and finish loading in the background.");
+    QCommandLineOption startupTraceOption("startup-trace",
+        "Print the startup timings and memory use, and when each startup task ran and on which thread; save the task timings as a Chrome trace to <file>.", "file");
+    QCommandLineOption textureDirOption("texture-dir",
+        "Also load the .png files in <directory> as textures, and new ones as they are added.", "directory");
+    QCommandLineOption mipmapsOption("mipmaps",
+        "Give every texture a mip chain generated on the GPU, rebuilt for dynamic cube maps after each update.");
+    QCommandLineOption benchmarkMinificationOption("benchmark-minification",
+        "Once loaded, time the scene from the farther zoom levels with and without mipmaps.");
+    QCommandLineOption textureArrayOption("texture-array",
+        "Keep the box textures as layers of one array texture, so switching textures needs no rebinding.");
+    QCommandLineOption textureCacheOption("texture-cache",
+        "Keep the textures in the cache in the form the GPU takes, block-compressed where supported, and map them from there.");
+    QCommandLineOption benchmarkTextureCacheOption("benchmark-texture-cache",
+        "Once loaded, compare the load time and size of decoded textures with those from the texture cache.");
+    QCommandLineOption textureBudgetOption("texture-budget",
+        "Keep textures and render targets within <MB> of video memory, evicting or downsizing the least recently used.", "MB");
+    QCommandLineOption perFaceCubemapsOption("per-face-cubemaps",
+        "Render dynamic cube maps one face at a time, even where a geometry shader could draw all six faces in one pass.");
+    QCommandLineOption benchmarkCubemapsOption("benchmark-cubemaps",
+        "Once loaded, time updating the dynamic cube maps one face at a time and in one pass.");
+    QCommandLineOption offscreenOption("offscreen",
+        "Render the main view into an offscreen texture and draw that into the window.");
+    QCommandLineOption offscreenSamplesOption("offscreen-samples",
+        "With --offscreen, render with <n> samples per pixel and resolve them into the texture.", "n", "0");
+    QCommandLineOption offscreenCaptureOption("offscreen-capture",
+        "Once loaded, save the offscreen view to <file>. Implies --offscreen.", "file");
+    QCommandLineOption cubemapBudgetOption("cubemap-budget",
+        "GPU time per frame for updating dynamic cube maps that are out of date, in milliseconds, 0 for no limit (default 3).", "ms", "3");
+    QCommandLineOption fixedCubemapSizeOption("fixed-cubemap-size",
+        "Keep dynamic cube maps at full size, however small their boxes appear on screen.");
+    QCommandLineOption redrawCubemapBackgroundOption("redraw-cubemap-background",
+        "Draw the environment into every dynamic cube map update instead of copying it from a cached cube map.");
+    QCommandLineOption fullProbeMaterialsOption("full-probe-materials",
+        "Shade boxes in dynamic cube maps with their full shaders, not the REFLECTION_PROBE variants or the flat fallback.");
+    parser.addOption(noiseSizeOption);
+    parser.addOption(noiseSeedOption);
+    parser.addOption(noCacheOption);
+    parser.addOption(cacheDirOption);
+    parser.addOption(gpuNoiseOption);
+    parser.addOption(verifyGpuNoiseOption);
+    parser.addOption(progressiveOption);
+    parser.addOption(startupTraceOption);
+    parser.addOption(textureDirOption);
+    parser.addOption(mipmapsOption);
+    parser.addOption(benchmarkMinificationOption);
+    parser.addOption(textureArrayOption);
+    parser.addOption(textureCacheOption);
+    parser.addOption(benchmarkTextureCacheOption);
+    parser.addOption(textureBudgetOption);
+    parser.addOption(perFaceCubemapsOption);
+    parser.addOption(benchmarkCubemapsOption);
+    parser.addOption(offscreenOption);
+    parser.addOption(offscreenSamplesOption);
+    parser.addOption(offscreenCaptureOption);
+    parser.addOption(cubemapBudgetOption);
+    parser.addOption(fixedCubemapSizeOption);
+    parser.addOption(redrawCubemapBackgroundOption);
+    parser.addOption(fullProbeMaterialsOption);
+    parser.process(app);
+
+    SceneOptions options;
+    int noiseSize = parser.value(noiseSizeOption).toInt();
+    if (noiseSize >= 8 && noiseSize <= 512 && (noiseSize & (noiseSize - 1)) == 0)
+        options.noiseSize = noiseSize;
+    else
+        qWarning("Invalid noise size %d, using %d.", noiseSize, options.noiseSize);
+    options.noiseSeed = parser.value(noiseSeedOption).toUInt();
+    options.useCache = !parser.isSet(noCacheOption);
+    options.cacheDirectory = parser.value(cacheDirOption);
+    options.gpuNoise = parser.isSet(gpuNoiseOption);
+    options.verifyGpuNoise = parser.isSet(verifyGpuNoiseOption);
+    options.progressive = parser.isSet(progressiveOption);
+    options.startupTrace = parser.value(startupTraceOption);
+    options.textureDirectory = parser.value(textureDirOption);
+    options.mipmaps = parser.isSet(mipmapsOption);
+    options.benchmarkMinification = parser.isSet(benchmarkMinificationOption);
+    options.textureArray = parser.isSet(textureArrayOption);
+    options.textureCache = parser.isSet(textureCacheOption);
+    options.benchmarkTextureCache = parser.isSet(benchmarkTextureCacheOption);
+    options.textureBudget = qint64(qMax(0, parser.value(textureBudgetOption).toInt())) * 1024 * 1024;
+    options.layeredCubemaps = !parser.isSet(perFaceCubemapsOption);
+    options.benchmarkCubemaps = parser.isSet(benchmarkCubemapsOption);
+    options.offscreenCapture = parser.value(offscreenCaptureOption);
+    options.offscreen = parser.isSet(offscreenOption) || !options.offscreenCapture.isEmpty();
+    options.offscreenSamples = qMax(0, parser.value(offscreenSamplesOption).toInt());
+    options.cubemapBudget = qMax(0.0f, parser.value(cubemapBudgetOption).toFloat());
+    options.cubemapTiers = !parser.isSet(fixedCubemapSizeOption);
+    options.cubemapEnvironmentLayer = !parser.isSet(redrawCubemapBackgroundOption);
+    options.probeMaterials = !parser.isSet(fullProbeMaterialsOption);
+
     //**************************
     /// Определяем версию OpenGL
     /// Если всё плохо, выходим
@@ -154,12 +262,14 @@ int main(int argc, char **argv)
         "work poorly or not at all on your system.");//*/
 
     widget->makeCurrent(); // The current context must be set before calling Scene's constructor
-    Scene scene(1024, 768, maxTextureSize);     // создаём экземпляр дочернего класса (смотрим, чито у нас там в классе наворочено)
+    Scene scene(1024, 768, maxTextureSize, options);     // создаём экземпляр дочернего класса (смотрим, чито у нас там в классе наворочено)
     GraphicsView view;                          // создаём экземпляр дочернего класса (смотрим определение выше)
     view.setViewport(widget);
     view.setViewportUpdateMode(QGraphicsView::FullViewportUpdate);
     view.setScene(&scene);
     view.show();
 
-    return app.exec();
+    int result = app.exec();
+    ResourceRegistry::instance()->clear();  // кэш переживает QApplication, чистим его заранее
+    return result;
 }
@@ -0,0 +1,238 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "noisevolume.h"
+
+#include "3rdparty/fbm.h"
+
+// Header of a noise cache file. The texel data follows directly.
+struct NoiseCacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 algorithm;
+    quint32 seed;
+    quint32 size;
+    quint32 lattice;
+    quint32 texelSize;
+    quint32 reserved;
+};
+
+static const char NOISE_CACHE_MAGIC[4] = {'B', 'X', 'N', 'V'};
+static const quint32 NOISE_CACHE_VERSION = 1;
+
+class NoiseSlabTask : public QRunnable
+{
+public:
+    NoiseSlabTask(const NoiseVolume *volume, int zBegin, int zEnd, uchar *out)
+        : m_volume(volume), m_zBegin(zBegin), m_zEnd(zEnd), m_out(out) {}
+    virtual void run() Q_DECL_OVERRIDE {m_volume->generateSlab(m_zBegin, m_zEnd, m_out);}
+private:
+    const NoiseVolume *m_volume;
+    int m_zBegin, m_zEnd;
+    uchar *m_out;
+};
+
+//============================================================================//
+//                                 NoiseVolume                                //
+//============================================================================//
+
+NoiseVolume::NoiseVolume(int size, unsigned int seed, int lattice, int channels)
+    : m_size(size)
+    , m_seed(seed)
+    , m_lattice(lattice)
+    , m_channels(channels == 1 || channels == 2 ? channels : 4)
+    , m_context(noise_context_create(seed, lattice))
+    , m_buffer(0)
+    , m_data(0)
+    , m_threadCount(0)
+    , m_elapsed(0)
+{
+    if (!m_context)
+        qWarning("NoiseVolume::NoiseVolume: Invalid lattice size %d, must be a power of two.", lattice);
+}
+
+NoiseVolume::~NoiseVolume()
+{
+    noise_context_destroy(m_context);
+    delete[] m_buffer;
+}
+
+void NoiseVolume::generate(int threadCount)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_cacheFile.isOpen())
+        m_cacheFile.close();
+    if (!m_buffer)
+        m_buffer = new uchar[byteCount()];
+    m_data = m_buffer;
+
+    m_threadCount = qBound(1, threadCount, m_size);
+    if (m_threadCount == 1) {
+        generateSlab(0, m_size, m_buffer);
+    } else {
+        // Several slabs per thread, so that a slow thread does not hold up the rest.
+        const qint64 sliceBytes = qint64(m_size) * m_size * m_channels;
+        QThreadPool pool;
+        pool.setMaxThreadCount(m_threadCount);
+        int slabCount = qMin(m_size, 4 * m_threadCount);
+        for (int slab = 0; slab < slabCount; ++slab) {
+            int zBegin = slab * m_size / slabCount;
+            pool.start(new NoiseSlabTask(this, zBegin, (slab + 1) * m_size / slabCount, m_buffer + zBegin * sliceBytes));
+        }
+        pool.waitForDone();
+    }
+
+    m_elapsed = timer.elapsed();
+}
+
+void NoiseVolume::generateSlab(int zBegin, int zEnd, uchar *out) const
+{
+    // Which four-channel byte (0 = blue ... 3 = alpha in memory) each packed
+    // channel copies: red is shifted in y, green in x.
+    static const int packedSource[2] = {2, 1};
+
+    if (!m_context) {
+        memset(out, 0, qint64(zEnd - zBegin) * m_size * m_size * m_channels);
+        return;
+    }
+
+    const float scale = noise_context_size(m_context) / (float)m_size;
+    const int shift = m_size / 8;
+    QVector<float> x(m_size), y(m_size), z(m_size), value(m_size);
+
+    for (int k = zBegin; k < zEnd; ++k) {
+        z.fill(k * scale);
+        for (int j = 0; j < m_size; ++j) {
+            uchar *row = out + qint64(((k - zBegin) * m_size + j) * m_size) * m_channels;
+            // One row of each channel at a time, so the noise kernels see long runs.
+            for (int channel = 0; channel < m_channels; ++channel) {
+                int byte = (m_channels == 4 ? channel : packedSource[channel]);
+                for (int i = 0; i < m_size; ++i)
+                    x[i] = (i + (byte & 1) * shift) * scale;
+                y.fill((j + ((byte & 2) >> 1) * shift) * scale);
+                noise3_array_r(m_context, x.constData(), y.constData(), z.constData(), value.data(), m_size);
+                for (int i = 0; i < m_size; ++i)
+                    row[i * m_channels + channel] = uchar(qMin(255, (int)(128.0f * (value[i] + 1.0f))));
+            }
+        }
+    }
+}
+
+QString NoiseVolume::cacheFileName(const QString &directory) const
+{
+    return QDir(directory).filePath(QString("noise-v%1-a%2-%3x%4-%5-%6.bin")
+        .arg(NOISE_CACHE_VERSION).arg(int(Algorithm)).arg(m_size).arg(m_channels).arg(m_lattice).arg(m_seed));
+}
+
+bool NoiseVolume::loadCache(const QString &fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 texelBytes = byteCount();
+    QFile &file = m_cacheFile;
+    if (file.isOpen())
+        file.close();
+    m_data = m_buffer;
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    NoiseCacheHeader header;
+    if (file.size() != qint64(sizeof(header)) + texelBytes
+        || file.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header))
+        || memcmp(header.magic, NOISE_CACHE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != NOISE_CACHE_VERSION
+        || header.algorithm != quint32(Algorithm)
+        || header.seed != m_seed
+        || header.size != quint32(m_size)
+        || header.lattice != quint32(m_lattice)
+        || header.texelSize != quint32(m_channels)) {
+        qWarning() << "NoiseVolume::loadCache: Ignoring stale or damaged cache file" << fileName;
+        file.close();
+        return false;
+    }
+
+    // The mapping stays valid until the file is closed.
+    uchar *texels = file.map(sizeof(header), texelBytes);
+    if (!texels) {
+        file.close();
+        return false;
+    }
+    m_data = texels;
+
+    m_elapsed = timer.elapsed();
+    return true;
+}
+
+bool NoiseVolume::saveCache(const QString &fileName) const
+{
+    if (!m_data || !m_context)
+        return false;
+
+    QSaveFile file(fileName);
+    if (!beginCacheFile(file))
+        return false;
+    file.write(reinterpret_cast<const char *>(m_data), byteCount());
+    if (!file.commit()) {
+        qWarning() << "NoiseVolume::saveCache: Failed to write" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Opens 'file' and writes the header for this volume's key to it.
+bool NoiseVolume::beginCacheFile(QSaveFile &file) const
+{
+    if (!m_context)
+        return false;
+
+    QDir().mkpath(QFileInfo(file.fileName()).absolutePath());
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    NoiseCacheHeader header;
+    memcpy(header.magic, NOISE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = NOISE_CACHE_VERSION;
+    header.algorithm = Algorithm;
+    header.seed = m_seed;
+    header.size = m_size;
+    header.lattice = m_lattice;
+    header.texelSize = m_channels;
+    header.reserved = 0;
+
+    return file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+}
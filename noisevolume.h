@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef NOISEVOLUME_H
+#define NOISEVOLUME_H
+
+#include <QtWidgets>
+
+struct NoiseContext;
+
+// Generates the noise volume that the fragment shaders sample as 'noise'.
+// Every channel holds the same Perlin noise, shifted by an eighth of the
+// volume in x and/or y. The volume spans exactly one period of noise with
+// 'lattice' cells, so it tiles for any size. The Z slices are split into
+// slabs which are filled in parallel from one shared, read-only noise context.
+//
+// With four channels the texels are QRgb values for a BGRA upload. With one
+// or two channels they are packed R or RG bytes holding what the shaders
+// would have read from .x and .y of the four-channel volume.
+//
+// A generated volume can be written to a cache file and memory-mapped back on
+// later runs. The file is keyed by seed, size, lattice, channel count and
+// Algorithm, which must be bumped whenever the generator's output changes.
+class NoiseVolume
+{
+public:
+    enum { Algorithm = 1 };
+
+    NoiseVolume(int size, unsigned int seed = 1, int lattice = 0x20, int channels = 4);
+    ~NoiseVolume();
+
+    // Fills the volume using up to 'threadCount' threads.
+    void generate(int threadCount = QThread::idealThreadCount());
+
+    // Maps the volume from 'fileName' if it holds one with the same key.
+    bool loadCache(const QString &fileName);
+    // Writes the generated volume to 'fileName', replacing it atomically.
+    bool saveCache(const QString &fileName) const;
+    // File name for this volume's key inside 'directory'.
+    QString cacheFileName(const QString &directory) const;
+
+    int size() const {return m_size;}
+    unsigned int seed() const {return m_seed;}
+    int channels() const {return m_channels;}
+    qint64 byteCount() const {return qint64(m_size) * m_size * m_size * m_channels;}
+    const uchar *data() const {return m_data;}
+    bool isCached() const {return m_cacheFile.isOpen();}
+    int threadCount() const {return m_threadCount;}
+    qint64 elapsed() const {return m_elapsed;} // generation or load time in milliseconds
+
+    // Writes slices [zBegin, zEnd) to 'out'. Safe to call from several threads.
+    void generateSlab(int zBegin, int zEnd, uchar *out) const;
+    // Opens 'file' and writes the header for this volume's key. The caller
+    // appends all slices in order and commits the file.
+    bool beginCacheFile(QSaveFile &file) const;
+private:
+
+    int m_size;
+    unsigned int m_seed;
+    int m_lattice;
+    int m_channels;
+    NoiseContext *m_context;
+    uchar *m_buffer;            // owned storage when generated
+    const uchar *m_data;        // either m_buffer or the mapped cache file
+    QFile m_cacheFile;
+    int m_threadCount;
+    qint64 m_elapsed;
+};
+
+#endif
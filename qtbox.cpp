@@ -32,6 +32,7 @@
 ****************************************************************************/
 
 #include "qtbox.h"
+#include "resourceregistry.h"
 
 const qreal ROTATE_SPEED_X = 30.0 / 1000.0;
 const qreal ROTATE_SPEED_Y = 20.0 / 1000.0;
@@ -264,7 +265,7 @@ bool ItemBase::isInResizeArea(const QPointF &pos)
 //                                    QtBox                                   //
 //============================================================================//
 
-QtBox::QtBox(int size, int x, int y) : ItemBase(size, x, y), m_texture(0)
+QtBox::QtBox(int size, int x, int y) : ItemBase(size, x, y)
 {
     for (int i = 0; i < 8; ++i) {
         m_vertices[i].setX(i & 1 ? 0.5f : -0.5f);
@@ -285,8 +286,6 @@ QtBox::QtBox(int size, int x, int y) : ItemBase(size, x, y), m_texture(0)
 
 QtBox::~QtBox()
 {
-    if (m_texture)
-        delete m_texture;
 }
 
 ItemBase *QtBox::createNew(int size, int x, int y)
@@ -328,8 +327,9 @@ void QtBox::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWi
     glEnable(GL_COLOR_MATERIAL);
     glEnable(GL_NORMALIZE);
 
-    if(m_texture == 0)
-        m_texture = new GLTexture2D(":/res/boxes/qt-logo.jpg", 64, 64);
+    // All boxes share one logo texture.
+    if (!m_texture)
+        m_texture = ResourceRegistry::instance()->texture2D(":/res/boxes/qt-logo.jpg", 64, 64);
     m_texture->bind();
     glEnable(GL_TEXTURE_2D);
 
@@ -447,7 +447,7 @@ ItemBase *CircleItem::createNew(int size, int x, int y)
 
 SquareItem::SquareItem(int size, int x, int y) : ItemBase(size, x, y)
 {
-    m_image = QPixmap(":/res/boxes/square.jpg");
+    m_image = ResourceRegistry::instance()->pixmap(":/res/boxes/square.jpg");
 }
 
 void SquareItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
@@ -82,7 +82,7 @@ private:
     QVector3D m_vertices[8];
     QVector3D m_texCoords[4];
     QVector3D m_normals[6];
-    GLTexture *m_texture;
+    QSharedPointer<GLTexture2D> m_texture;
 };
 
 class CircleItem : public ItemBase
@@ -0,0 +1,89 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "resourceregistry.h"
+
+ResourceRegistry *ResourceRegistry::instance()
+{
+    static ResourceRegistry registry;
+    return &registry;
+}
+
+QSharedPointer<GLTexture2D> ResourceRegistry::texture2D(const QString &fileName, int width, int height)
+{
+    prune();
+    const QString key = QString("%1|%2x%3|rgba").arg(fileName).arg(width).arg(height);
+    QSharedPointer<GLTexture2D> texture = m_textures.value(key).toStrongRef();
+    if (!texture) {
+        texture = QSharedPointer<GLTexture2D>(new GLTexture2D(fileName, width, height));
+        m_textures.insert(key, texture);
+    }
+    return texture;
+}
+
+QPixmap ResourceRegistry::pixmap(const QString &fileName, const QSize &size)
+{
+    prune();
+    const QString key = QString("%1|%2x%3").arg(fileName).arg(size.width()).arg(size.height());
+    QHash<QString, QPixmap>::const_iterator it = m_pixmaps.constFind(key);
+    if (it != m_pixmaps.constEnd())
+        return it.value();
+
+    QPixmap pixmap(fileName);
+    if (!pixmap.isNull() && size.isValid() && pixmap.size() != size)
+        pixmap = pixmap.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    m_pixmaps.insert(key, pixmap);
+    return pixmap;
+}
+
+void ResourceRegistry::clear()
+{
+    m_textures.clear();
+    m_pixmaps.clear();
+}
+
+// Drops the entries whose resources have no users left.
+void ResourceRegistry::prune()
+{
+    QMutableHashIterator<QString, QWeakPointer<GLTexture2D> > textures(m_textures);
+    while (textures.hasNext()) {
+        if (textures.next().value().isNull())
+            textures.remove();
+    }
+    QMutableHashIterator<QString, QPixmap> pixmaps(m_pixmaps);
+    while (pixmaps.hasNext()) {
+        // The registry's copy is the last one.
+        if (pixmaps.next().value().isDetached())
+            pixmaps.remove();
+    }
+}
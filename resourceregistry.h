@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef RESOURCEREGISTRY_H
+#define RESOURCEREGISTRY_H
+
+#include "glbuffers.h"
+
+// Hands out shared textures and pixmaps, so items that all show the same
+// image decode and upload it once. A resource is keyed by its source, size
+// and format, created on the first request for the key and freed when the
+// last handle to it goes away. All calls belong on the GUI thread, which is
+// the one with the GL context.
+class ResourceRegistry
+{
+public:
+    static ResourceRegistry *instance();
+
+    // 'fileName' scaled to width x height, or at its own size for 0.
+    QSharedPointer<GLTexture2D> texture2D(const QString &fileName, int width = 0, int height = 0);
+    // 'fileName' scaled to 'size', or at its own size for an invalid one.
+    // QPixmap is shared by value; the registry lets go of a pixmap once it
+    // holds the only copy.
+    QPixmap pixmap(const QString &fileName, const QSize &size = QSize());
+
+    // Lets go of every cached resource. Call before QApplication is
+    // destroyed, since the registry itself outlives it.
+    void clear();
+
+private:
+    ResourceRegistry() {}
+    void prune();
+
+    QHash<QString, QWeakPointer<GLTexture2D> > m_textures;
+    QHash<QString, QPixmap> m_pixmaps;
+
+    Q_DISABLE_COPY(ResourceRegistry)
+};
+
+#endif
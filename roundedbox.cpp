@@ -56,6 +56,7 @@ float lerp(float a, float b, float t)
 
 GLRoundedBox::GLRoundedBox(float r, float scale, int n)
     : GLTriangleMesh<P3T2N3Vertex, unsigned short>((n+2)*(n+3)*4, (n+1)*(n+1)*24+36+72*(n+1))
+    , m_boundingRadius(0.0f)
 {
     int vidx = 0, iidx = 0;
     int vertexCountPerCorner = (n + 2) * (n + 3) / 2;
@@ -126,6 +127,7 @@ GLRoundedBox::GLRoundedBox(float r, float scale, int n)
                 QVector3D pos = centre * (offset + r * normal);
 
                 vp[vidx].position = scale * pos;
+                m_boundingRadius = qMax(m_boundingRadius, vp[vidx].position.length());
                 vp[vidx].normal = centre * normal;
                 vp[vidx].texCoord = QVector2D(pos.x() + 0.5f, pos.y() + 0.5f);
 
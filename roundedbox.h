@@ -58,6 +58,10 @@ class GLRoundedBox : public GLTriangleMesh<P3T2N3Vertex, unsigned short>
 public:
     // 0 < r < 0.5, 0 <= n <= 125
     explicit GLRoundedBox(float r = 0.25f, float scale = 1.0f, int n = 10);
+    // Radius of the sphere around the origin that holds every vertex.
+    float boundingRadius() const {return m_boundingRadius;}
+private:
+    float m_boundingRadius;
 };
 
 
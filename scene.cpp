@@ -36,8 +36,15 @@
 #include <QtGui/qmatrix4x4.h>
 #include <QtGui/qvector3d.h>
 #include <cmath>
+#include <cstring>
 
-#include "3rdparty/fbm.h"
+#include "cubemapscheduler.h"
+#include "gpunoisevolume.h"
+#include "noisevolume.h"
+#include "taskgraph.h"
+#include "texturecache.h"
+#include "textureresidency.h"
+#include "texturestreamer.h"
 
 void checkGLErrors(const QString& prefix)
 {
@@ -73,26 +80,58 @@ void checkGLErrors(const QString& prefix)
 //                                    Scene                                   //
 //============================================================================//
 
-Scene::Scene(int width, int height, int maxTextureSize)
+Scene::Scene(int width, int height, int maxTextureSize, const SceneOptions &options)
     : m_distExp(600)
     , m_frame(0)
     , m_maxTextureSize(maxTextureSize)
+    , m_options(options)
     , m_currentShader(0)
     , m_currentTexture(0)
     , m_dynamicCubemap(false)
     , m_updateAllCubemaps(true)
     , m_box(0)
+    , m_noise(0)
     , m_vertexShader(0)
+    , m_environment(0)
     , m_environmentShader(0)
     , m_environmentProgram(0)
+    , m_layeredCubemaps(false)
+    , m_layeredPass(false)
+    , m_layeredVertexShader(0)
+    , m_cubemapGeometryShader(0)
+    , m_layeredEnvironmentProgram(0)
+    , m_probePass(false)
+    , m_probeFallbackShader(0)
+    , m_drawCalls(0)
+    , m_culledDraws(0)
+    , m_boxLayers(AllLayers)
+    , m_offscreenTarget(0)
+    , m_cubemapScheduler(0)
+    , m_startup(0)
+    , m_parametersTask(-1)
+    , m_firstShaderTask(-1)
+    , m_placeholderTexture(0)
+    , m_textureArray(0)
+    , m_loadingNoise(0)
+    , m_loadingNoiseTexture(0)
+    , m_noiseSlabDepth(1)
+    , m_noiseSlabCount(0)
+    , m_noiseCacheFile(0)
+    , m_environmentCache(0)
+    , m_textureStreamer(0)
+    , m_textureWatcher(0)
+    , m_overTextureBudget(false)
 {
+    m_startupTimer.start();             // отсюда считаем время до первого кадра и до полной загрузки
+    buildStartupGraph();                // декодирование и чтение файлов идёт, пока создаются панели
     setSceneRect(0, 0, width, height);  // устанавливаем прямоугольник отсечения сцены
 
     m_trackBalls[0] = TrackBall(0.05f, QVector3D(0, 1, 0), TrackBall::Sphere);  // создаём орбиту (вокруг оси Y) для центрального куба (правильного гексаэдра) (угловая скорость, ось, модель вращения)
     m_trackBalls[1] = TrackBall(0.005f, QVector3D(0, 0, 1), TrackBall::Sphere); // создаём орбиту для кольца гексаэдров (вокруг оси Z)
     m_trackBalls[2] = TrackBall(0.0f, QVector3D(0, 1, 0), TrackBall::Plane);    // создаём орбиту для камеры ???
 
-    m_renderOptions = new RenderOptionsDialog;              // создаём панель управления №1
+    m_startup->wait(m_parametersTask, false);               // панели нужны .par файлы, GL узлы пока не трогаем
+    m_renderOptions = new RenderOptionsDialog(m_parameters);    // создаём панель управления №1
     m_renderOptions->move(20, 120);                         // перемещаем её в угол
     m_renderOptions->resize(m_renderOptions->sizeHint());   // устанавливаем размер по рекомендованному
 
@@ -134,12 +173,23 @@ Scene::Scene(int width, int height, int maxTextureSize)
 
 Scene::~Scene()
 {
+    delete m_startup;                   // ждёт узлы, которые ещё пишут в члены сцены
+    delete m_loadingNoise;
+    delete m_loadingNoiseTexture;
+    delete m_noiseCacheFile;            // без commit() файл кэша не появится
+    qDeleteAll(m_noiseRing);
+    delete m_environmentCache;
+    qDeleteAll(m_textureCaches);
+    delete m_textureStreamer;           // ждёт декодирование, которое ещё идёт
+    delete m_placeholderTexture;
+    delete m_textureArray;
     if (m_box)
         delete m_box;
     foreach (GLTexture *texture, m_textures)
         if (texture) delete texture;
     if (m_mainCubemap)
         delete m_mainCubemap;
+    clearEnvironmentLayers();
     foreach (QGLShaderProgram *program, m_programs)
         if (program) delete program;
     if (m_vertexShader)
@@ -152,6 +202,179 @@ Scene::~Scene()
         delete m_environmentShader;
     if (m_environmentProgram)
         delete m_environmentProgram;
+    qDeleteAll(m_layeredPrograms);
+    delete m_layeredEnvironmentProgram;
+    delete m_layeredVertexShader;
+    delete m_cubemapGeometryShader;
+    qDeleteAll(m_probePrograms);
+    qDeleteAll(m_probeFragmentShaders);
+    delete m_probeFallbackShader;
+    delete m_offscreenTarget;
+    delete m_cubemapScheduler;
+}
+
+// Returns how many channels of the 'noise' volume the fragment shaders read:
+// one for '.x', two for '.xy' and so on, four when a call has no swizzle.
+static int noiseChannelsSampled(const QVector<QByteArray> &sources)    // сколько каналов шума реально читают шейдеры
+{
+    static const char components[] = "xyzwrgbastpq";
+    int channels = 1;
+    foreach (const QByteArray &source, sources) {
+        if (source.isEmpty())
+            return 4;                                                       // файл не прочитался, берём с запасом
+        int pos = 0;
+        while ((pos = source.indexOf("texture3D", pos)) != -1) {
+            pos += 9;
+            int open = pos;
+            while (open < source.size() && QChar(source.at(open)).isSpace())
+                ++open;
+            if (open >= source.size() || source.at(open) != '(')
+                continue;
+            int arg = open + 1;
+            while (arg < source.size() && QChar(source.at(arg)).isSpace())
+                ++arg;
+            if (!source.mid(arg).startsWith("noise"))
+                continue;
+            int depth = 0, close = open;
+            for (; close < source.size(); ++close) {
+                if (source.at(close) == '(')
+                    ++depth;
+                else if (source.at(close) == ')' && --depth == 0)
+                    break;
+            }
+            if (close + 1 >= source.size() || source.at(close + 1) != '.')
+                return 4;                                                   // без свиззла шейдер берёт весь вектор
+            for (int i = close + 2; i < source.size(); ++i) {
+                const char *c = source.at(i) ? strchr(components, source.at(i)) : 0;
+                if (!c)
+                    break;
+                channels = qMax(channels, int(c - components) % 4 + 1);
+            }
+            pos = close;
+        }
+    }
+    return channels;
+}
+
+// Decodes an image and scales it to size x size ARGB32. A null image means
+// the file could not be read.
+static QImage loadImage(const QString &fileName, int size)
+{
+    QImage image(fileName);
+    if (!image.isNull()) {
+        image = image.convertToFormat(QImage::Format_ARGB32);
+        if (image.width() != size || image.height() != size)
+            image = image.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+// A node of the startup task graph: calls 'method' of 'scene' with
+// 'argument', the index of the face, file or slab the node works on.
+class SceneTask : public QRunnable
+{
+public:
+    SceneTask(Scene *scene, void (Scene::*method)(int), int argument = 0)
+        : m_scene(scene), m_method(method), m_argument(argument) {}
+    virtual void run() Q_DECL_OVERRIDE {(m_scene->*m_method)(m_argument);}
+private:
+    Scene *m_scene;
+    void (Scene::*m_method)(int);
+    int m_argument;
+};
+
+// Граф старта. Узлы на рабочих потоках декодируют картинки, читают файлы и
+// считают шум; узлы с GL выполняются по одному на потоке контекста внутри
+// initGL() или, при прогрессивном старте, в начале кадров.
+void Scene::buildStartupGraph()
+{
+    m_startup = new TaskGraph;
+
+    m_parametersTask = m_startup->addTask("parameters: read .par files", new SceneTask(this, &Scene::readParameters));
+
+    // фон: шесть граней декодируются параллельно, в GL идут вместе
+    m_environmentFiles << ":/res/boxes/cubemap_posx.jpg" << ":/res/boxes/cubemap_negx.jpg" << ":/res/boxes/cubemap_posy.jpg"
+                       << ":/res/boxes/cubemap_negy.jpg" << ":/res/boxes/cubemap_posz.jpg" << ":/res/boxes/cubemap_negz.jpg";
+    m_environmentFaces.resize(m_environmentFiles.size());
+    QList<int> environmentCache;
+    if (m_options.textureCache && m_options.useCache) {     // если куб уже в кэше, грани не декодируются
+        m_environmentCache = new TextureCacheFile("environment", m_environmentFiles, qMin(1024, m_maxTextureSize));
+        environmentCache << m_startup->addTask("environment: map cache", new SceneTask(this, &Scene::mapEnvironmentCache));
+    }
+    QList<int> faces;
+    for (int face = 0; face < m_environmentFiles.size(); ++face)
+        faces << m_startup->addTask("environment: decode " + QFileInfo(m_environmentFiles.at(face)).fileName(),
+                                    new SceneTask(this, &Scene::decodeEnvironmentFace, face), TaskGraph::WorkerThread, environmentCache);
+    m_startup->addTask("environment: upload", new SceneTask(this, &Scene::uploadEnvironment), TaskGraph::ContextThread, faces);
+
+    // шейдеры читаются параллельно, а линкуются по порядку файлов, чтобы не менялся список эффектов
+    m_shaderFiles = QDir(":/res/boxes/").entryInfoList(QStringList("*.fsh"), QDir::Files | QDir::Readable);
+    m_shaderSources.resize(m_shaderFiles.size());
+    QList<int> shaderReads;
+    int link = -1;
+    for (int i = 0; i < m_shaderFiles.size(); ++i) {
+        QList<int> dependencies;
+        dependencies << m_startup->addTask("shader: read " + m_shaderFiles.at(i).fileName(),
+                                           new SceneTask(this, &Scene::readShaderSource, i));
+        shaderReads << dependencies.first();
+        if (link >= 0)
+            dependencies << link;
+        link = m_startup->addTask("shader: link " + m_shaderFiles.at(i).fileName(),
+                                  new SceneTask(this, &Scene::linkShader, i), TaskGraph::ContextThread, dependencies);
+        if (m_firstShaderTask < 0 || m_shaderFiles.at(i).fileName() == QLatin1String("basic.fsh"))
+            m_firstShaderTask = link;
+    }
+
+    // шум: каналы известны после чтения шейдеров, дальше либо GPU, либо слои на рабочих потоках
+    QList<int> prepare;
+    prepare << m_startup->addTask("noise: channels and cache", new SceneTask(this, &Scene::prepareNoise),
+                                  TaskGraph::WorkerThread, shaderReads);
+    if (m_options.gpuNoise && GpuNoiseVolume::isSupported()) {
+        m_startup->addTask("noise: render on GPU", new SceneTask(this, &Scene::renderGpuNoise), TaskGraph::ContextThread, prepare);
+    } else {
+        if (m_options.gpuNoise)
+            qWarning("Noise volume: GPU generation is not available, generating on the CPU.");
+        const int size = m_options.noiseSize;
+        // несколько слоёв на поток, чтобы медленный поток не держал остальных
+        int slabCount = qBound(1, 4 * WorkStealingPool::globalInstance()->threadCount(), size);
+        m_noiseSlabDepth = (size + slabCount - 1) / slabCount;
+        m_noiseSlabCount = (size + m_noiseSlabDepth - 1) / m_noiseSlabDepth;
+        // слоёв в работе не больше, чем буферов кольца: по одному на поток и один на загрузке
+        m_noiseRing.fill(0, qMin(m_noiseSlabCount, WorkStealingPool::globalInstance()->threadCount() + 1));
+        m_noiseSlots.fill(0, m_noiseRing.size());
+        QList<int> staging;
+        staging << m_startup->addTask("noise: staging buffers", new SceneTask(this, &Scene::beginNoiseUpload),
+                                      TaskGraph::ContextThread, prepare);
+        QList<int> uploads;
+        for (int slab = 0; slab < m_noiseSlabCount; ++slab) {
+            QList<int> generate = staging;
+            if (slab >= m_noiseRing.size())             // буфер освобождает загрузка слоя, бывшего в нём кругом раньше
+                generate << uploads.at(slab - m_noiseRing.size());
+            QList<int> dependencies;
+            dependencies << m_startup->addTask(QString("noise: slab %1").arg(slab),
+                                               new SceneTask(this, &Scene::generateNoiseSlab, slab), TaskGraph::WorkerThread, generate);
+            if (!uploads.isEmpty())
+                dependencies << uploads.last();
+            uploads << m_startup->addTask(QString("noise: upload slab %1").arg(slab),
+                                          new SceneTask(this, &Scene::uploadNoiseSlab, slab), TaskGraph::ContextThread, dependencies);
+        }
+    }
+
+    // png текстуры
+    m_textureFiles = QDir(":/res/boxes/").entryInfoList(QStringList("*.png"), QDir::Files | QDir::Readable);
+    m_textureImages.resize(m_textureFiles.size());
+    m_textureCaches.fill(0, m_textureFiles.size());
+    for (int i = 0; i < m_textureFiles.size(); ++i) {
+        if (m_options.textureCache && m_options.useCache && !m_options.textureArray)   // слои массива грузятся из картинок
+            m_textureCaches[i] = new TextureCacheFile(m_textureFiles.at(i).baseName(),
+                                                      QStringList(m_textureFiles.at(i).absoluteFilePath()), qMin(256, m_maxTextureSize));
+        QList<int> decode;
+        decode << m_startup->addTask("texture: decode " + m_textureFiles.at(i).fileName(), new SceneTask(this, &Scene::decodeTexture, i));
+        m_startup->addTask("texture: upload " + m_textureFiles.at(i).fileName(),
+                           new SceneTask(this, &Scene::uploadTexture, i), TaskGraph::ContextThread, decode);
+    }
+
+    m_startup->start();
 }
 
 void Scene::initGL()
@@ -161,108 +384,496 @@ void Scene::initGL()
     m_vertexShader = new QGLShader(QGLShader::Vertex);                                      // создаём переменную шейдеров
     m_vertexShader->compileSourceFile(QLatin1String(":/res/boxes/basic.vsh"));              // компилируем шейдеры
 
+    // динамические кубы за один проход: те же шейдеры, плюс геометрический, который раздаёт треугольники по граням
+    if (m_options.layeredCubemaps && GLRenderTargetCube::isLayeredSupported()) {
+        QFile file(QLatin1String(":/res/boxes/basic.vsh"));
+        file.open(QIODevice::ReadOnly);
+        m_layeredVertexShader = new QGLShader(QGLShader::Vertex);
+        m_cubemapGeometryShader = new QGLShader(QGLShader::Geometry);
+        m_layeredCubemaps = m_layeredVertexShader->compileSourceCode("#define LAYERED_CUBEMAP\n" + file.readAll())
+                && m_cubemapGeometryShader->compileSourceFile(QLatin1String(":/res/boxes/cubemap.gsh"));
+        if (!m_layeredCubemaps) {
+            qWarning("Layered cube maps: Failed to compile the shaders, rendering one face at a time.");
+            qWarning() << m_layeredVertexShader->log() << m_cubemapGeometryShader->log();
+        }
+    } else if (m_options.layeredCubemaps) {
+        qDebug("Layered cube maps: Not supported, rendering one face at a time.");
+    }
+
     // рисуем фон
     const static char environmentShaderText[] =             // шейдер для куба фона
         "uniform samplerCube env;"
         "void main() {"
             "gl_FragColor = textureCube(env, gl_TexCoord[1].xyz);"
         "}";
-    QStringList list;                                                                       // формируем список текстур фона
-    list << ":/res/boxes/cubemap_posx.jpg" << ":/res/boxes/cubemap_negx.jpg" << ":/res/boxes/cubemap_posy.jpg"
-         << ":/res/boxes/cubemap_negy.jpg" << ":/res/boxes/cubemap_posz.jpg" << ":/res/boxes/cubemap_negz.jpg";
-    m_environment = new GLTextureCube(list, qMin(1024, m_maxTextureSize));                  // создаём куб фона
+    if (m_options.progressive) {                                                            // пока грани декодируются, фон серый
+        const QRgb grey = qRgb(128, 128, 128);
+        m_environment = new GLTextureCube(1);
+        for (int face = 0; face < 6; ++face)
+            m_environment->load(1, face, &grey);
+    }                                                                                       // сам куб фона создаёт узел графа
     m_environmentShader = new QGLShader(QGLShader::Fragment);                               //
     m_environmentShader->compileSourceCode(environmentShaderText);
     m_environmentProgram = new QGLShaderProgram;
     m_environmentProgram->addShader(m_vertexShader);        //  добавляем программу
     m_environmentProgram->addShader(m_environmentShader);   //  к ней ещё одну (в GPU программа одна, это у нас она разбита)
     m_environmentProgram->link();
+    if (m_layeredCubemaps) {
+        m_layeredEnvironmentProgram = linkLayeredProgram(m_environmentShader);
+        m_layeredCubemaps = (m_layeredEnvironmentProgram != 0);
+    }
 
-    // формируем текстурную маску из шума
-    const int NOISE_SIZE = 128; // for a different size, B and BM in fbm.c must also be changed
-    m_noise = new GLTexture3D(NOISE_SIZE, NOISE_SIZE, NOISE_SIZE);
-    QRgb *data = new QRgb[NOISE_SIZE * NOISE_SIZE * NOISE_SIZE];
-    memset(data, 0, NOISE_SIZE * NOISE_SIZE * NOISE_SIZE * sizeof(QRgb));
-    QRgb *p = data;
-    float pos[3];
-    for (int k = 0; k < NOISE_SIZE; ++k) {
-        pos[2] = k * (0x20 / (float)NOISE_SIZE);
-        for (int j = 0; j < NOISE_SIZE; ++j) {
-            for (int i = 0; i < NOISE_SIZE; ++i) {
-                for (int byte = 0; byte < 4; ++byte) {
-                    pos[0] = (i + (byte & 1) * 16) * (0x20 / (float)NOISE_SIZE);
-                    pos[1] = (j + (byte & 2) * 8) * (0x20 / (float)NOISE_SIZE);
-                    *p |= (int)(128.0f * (noise3(pos) + 1.0f)) << (byte * 8);
-                }
-                ++p;
-            }
+    // в кубах отражений боксы без своего упрощённого варианта заливаются освещённым цветом
+    const static char probeFallbackShaderText[] =
+        "varying vec3 position, normal;"
+        "varying vec4 specular, ambient, diffuse, lightDirection;"
+        "void main() {"
+            "float NdotL = dot(normalize(normal), lightDirection.xyz);"
+            "gl_FragColor = (ambient + diffuse * max(NdotL, 0.0)) * gl_Color;"
+        "}";
+    if (m_options.probeMaterials) {
+        m_probeFallbackShader = new QGLShader(QGLShader::Fragment);
+        if (!m_probeFallbackShader->compileSourceCode(probeFallbackShaderText)) {
+            qWarning() << "Probe materials: Failed to compile the flat fallback:" << m_probeFallbackShader->log();
+            delete m_probeFallbackShader;
+            m_probeFallbackShader = 0;
         }
     }
-    m_noise->load(NOISE_SIZE, NOISE_SIZE, NOISE_SIZE, data);
-    delete[] data;
 
-    m_mainCubemap = new GLRenderTargetCube(512);        //
+    // формируем текстурную маску из шума
+    if (m_options.progressive) {                                                            // пока объём считается, шум плоский
+        const uchar flat[4] = {128, 128, 128, 128};
+        m_noise = new GLTexture3D(1, 1, 1, 4);
+        m_noise->load(1, 1, 1, flat);
+    }
 
-    QStringList filter;                                                                     // фильтр выбора файлов
-    QList<QFileInfo> files;                                                                 // список файлов
+    m_mainCubemap = new GLRenderTargetCube(512, m_options.cubemapTiers ? 64 : 0);     // ярусы 512 ... 64
+    m_cubemapScheduler = new CubemapScheduler;          // какие кубы перерисовывать в кадре
+    m_cubemapScheduler->setBudget(m_options.cubemapBudget);
+    if (m_options.mipmaps)                              // цепочка пересобирается после каждой отрисовки всех шести граней
+        m_mainCubemap->setMipmapped(true);
 
-    // Load all .png files as textures                                                      // загружаем все png файлы как текстуры  (куда грузим??)
+    // Load all .png files as textures                                                      // загружаем все png файлы как текстуры
     m_currentTexture = 0;                                                                   // индекс текущей текстуры
-    filter = QStringList("*.png");
-    files = QDir(":/res/boxes/").entryInfoList(filter, QDir::Files | QDir::Readable);       // наполняем список в соответствии с фильтром из файлов зарегистрированных как ресурс
-
-    foreach (QFileInfo file, files) {                                                       // для каждого файла
-        GLTexture *texture = new GLTexture2D(file.absoluteFilePath(), qMin(256, m_maxTextureSize), qMin(256, m_maxTextureSize));        // m_maxTextureSize определено 1024 в main.cpp, вот только qMin вернёт 256
-        if (texture->failed()) {
-            delete texture;
-            continue;
-        }
-        m_textures << texture;                              // ??? закидываем в массив текстур  (куда закидываем???)
-        m_renderOptions->addTexture(file.baseName());       // с соответствующим индексом будет имя текстуры в панели управления
+    foreach (QFileInfo file, m_textureFiles) {                                              // для каждого файла место в массиве,
+        m_textures << 0;                                                                    // текстуру туда положит узел графа,
+        m_renderOptions->addTexture(file.baseName());                                       // а до тех пор рисуется заглушка
     }
 
     if (m_textures.size() == 0)                                                                 // если не удалось запихать текстуры
         m_textures << new GLTexture2D(qMin(64, m_maxTextureSize), qMin(64, m_maxTextureSize));  // ??? формируем текстуру по умолчанию???
+    m_placeholderTexture = new GLTexture2D(qMin(64, m_maxTextureSize), qMin(64, m_maxTextureSize));
+
+    // массив текстур: смена текстуры - это только номер слоя в шейдере, без перепривязки
+    if (m_options.textureArray) {
+        if (!m_options.textureDirectory.isEmpty()) {
+            qWarning("Texture array: not used with --texture-dir, streamed textures may differ in size.");
+        } else if (!GLTexture2DArray::isSupported()) {
+            qWarning("Texture array: GL_EXT_texture_array is not available, using separate textures.");
+        } else if (!m_textureFiles.isEmpty()) {
+            const int size = qMin(256, m_maxTextureSize);       // тот же размер, что и в decodeTexture()
+            m_textureArray = new GLTexture2DArray(size, size, m_textureFiles.size());
+            if (m_textureArray->failed()) {
+                delete m_textureArray;
+                m_textureArray = 0;
+            } else if (m_options.mipmaps) {
+                m_textureArray->setMipmapped(true);             // цепочка пересобирается после каждого слоя
+            }
+        }
+    }
 
     // Load all .fsh files as fragment shaders                                         // загружаем все фрагментные шейдеры
     m_currentShader = 0;                                                                        // указатель индекса текущего шейдера
-    filter = QStringList("*.fsh");                                                              // устанавливаем маску выбора файлов
-    files = QDir(":/res/boxes/").entryInfoList(filter, QDir::Files | QDir::Readable);           //
-    foreach (QFileInfo file, files) {
-        QGLShaderProgram *program = new QGLShaderProgram;                                       // создаём новую программу для каждого файла
-        QGLShader* shader = new QGLShader(QGLShader::Fragment);                                 // создаём новый шейдер для каждого файла
-        shader->compileSourceFile(file.absoluteFilePath());                                     // компилируем шейдеры
-        /// The program does not take ownership over the shaders, so store them in a vector so they can be deleted afterwards.
-        program->addShader(m_vertexShader);                                                     // комбинируем программу из уже созданной основной вертексной и дополнительными фрагментными программами
-        program->addShader(shader);                                                             //
-        if (!program->link()) {                                                                 // линкуем программу  (куда?)
-            qWarning("Failed to compile and link shader program");
-            qWarning("Vertex shader log:");
-            qWarning() << m_vertexShader->log();
-            qWarning() << "Fragment shader log ( file =" << file.absoluteFilePath() << "):";
-            qWarning() << shader->log();
-            qWarning("Shader program log:");
-            qWarning() << program->log();
-
-            delete shader;
-            delete program;
-            continue;                   // дальше обрабатывать файл бесполезно, возвращаемся к началу цикла
+
+    // GL узлы графа выполняются здесь: при прогрессивном старте только до basic.fsh, остальное - в кадрах
+    if (!m_options.progressive)
+        m_startup->wait();
+    else if (m_firstShaderTask >= 0)
+        m_startup->wait(m_firstShaderTask);
+
+    if (m_programs.size() == 0) {                       // если с программами потерпели фиаско,
+        m_programs << new QGLShaderProgram;             // ???? запихиваем в массив программу по умолчанию
+        m_layeredCubemaps = false;                      // ей пары нет
+    }
+
+    m_renderOptions->emitParameterChanged();            // отсылаем сигналы изменения параметров отрисовки (для рисования)
+
+    TextureResidency::instance()->setBudget(m_options.textureBudget);
+    if (!m_options.textureDirectory.isEmpty() || m_options.textureBudget > 0) {     // новые и выгруженные текстуры грузятся без задержки кадров
+        m_textureStreamer = new TextureStreamer(3, this);
+        connect(m_textureStreamer, SIGNAL(textureReady(int,GLTexture2D*)), this, SLOT(textureStreamed(int,GLTexture2D*)));
+        connect(m_textureStreamer, SIGNAL(textureFailed(int,QString)), this, SLOT(textureStreamFailed(int)));
+    }
+    if (!m_options.textureDirectory.isEmpty()) {        // каталог с текстурами, которые можно подкладывать во время работы
+        m_textureWatcher = new QFileSystemWatcher(QStringList(m_options.textureDirectory), this);
+        connect(m_textureWatcher, SIGNAL(directoryChanged(QString)), this, SLOT(textureDirectoryChanged(QString)));
+        textureDirectoryChanged(m_options.textureDirectory);
+    }
+
+    if (m_startup->isFinished())
+        finishStartup();
+}
+
+void Scene::finishStartup()
+{
+    if (!m_options.startupTrace.isEmpty()) {                // отчёт о загрузке только по --startup-trace
+        qDebug("Startup: fully loaded after %lld ms", m_startupTimer.elapsed());
+        TextureResidency *residency = TextureResidency::instance();
+        qDebug("Texture memory: %lld KB in %d textures, %lld KB of depth buffers, budget %s",
+               residency->textureBytes() / 1024, residency->textureCount(), residency->renderBufferBytes() / 1024,
+               residency->budget() > 0 ? qPrintable(QString("%1 KB").arg(residency->budget() / 1024)) : "unlimited");
+        GLDepthBufferPool *depthBuffers = GLDepthBufferPool::instance();
+        qDebug("Depth buffers: %d shared, %lld KB saved by sharing",
+               depthBuffers->bufferCount(), depthBuffers->savedBytes() / 1024);
+        m_startup->printTrace();
+        m_startup->writeTrace(m_options.startupTrace);
+    }
+    delete m_startup;
+    m_startup = 0;
+    m_shaderSources.clear();
+}
+
+bool Scene::loadShader(const QFileInfo &file, const QByteArray &source)
+{
+    QGLShaderProgram *program = new QGLShaderProgram;                                       // создаём новую программу для каждого файла
+    QGLShader* shader = new QGLShader(QGLShader::Fragment);                                 // создаём новый шейдер для каждого файла
+    if (m_textureArray)                                                                     // tex - массив, слой задаёт texLayer
+        shader->compileSourceCode("#define TEXTURE_ARRAY\n" + source);
+    else
+        shader->compileSourceCode(source);                                                  // компилируем шейдеры
+    /// The program does not take ownership over the shaders, so store them in a vector so they can be deleted afterwards.
+    program->addShader(m_vertexShader);                                                     // комбинируем программу из уже созданной основной вертексной и дополнительными фрагментными программами
+    program->addShader(shader);                                                             //
+    if (!program->link()) {                                                                 // линкуем программу  (куда?)
+        qWarning("Failed to compile and link shader program");
+        qWarning("Vertex shader log:");
+        qWarning() << m_vertexShader->log();
+        qWarning() << "Fragment shader log ( file =" << file.absoluteFilePath() << "):";
+        qWarning() << shader->log();
+        qWarning("Shader program log:");
+        qWarning() << program->log();
+
+        delete shader;
+        delete program;
+        return false;               // дальше обрабатывать файл бесполезно
+    }
+
+    if (m_fragmentShaders.isEmpty() && !m_programs.isEmpty()) {    // убираем программу по умолчанию, если она успела появиться
+        qDeleteAll(m_programs);
+        m_programs.clear();
+    }
+
+    // в кубы отражений - вариант подешевле: из того же файла с REFLECTION_PROBE, иначе плоская заливка
+    QGLShader *probeShader = shader;
+    QGLShader *probeVariant = 0;
+    QGLShaderProgram *probeProgram = 0;
+    if (m_options.probeMaterials) {
+        probeShader = m_probeFallbackShader;
+        if (source.contains("REFLECTION_PROBE")) {
+            probeVariant = new QGLShader(QGLShader::Fragment);
+            if (probeVariant->compileSourceCode(QByteArray("#define REFLECTION_PROBE\n")
+                                                + (m_textureArray ? "#define TEXTURE_ARRAY\n" : "") + source)) {
+                probeShader = probeVariant;
+            } else {
+                qWarning() << "Probe materials: Failed to compile the REFLECTION_PROBE variant of"
+                           << file.fileName() << ", using the flat fallback:" << probeVariant->log();
+                delete probeVariant;
+                probeVariant = 0;
+            }
+        }
+        if (probeShader) {
+            probeProgram = new QGLShaderProgram;
+            probeProgram->addShader(m_vertexShader);
+            probeProgram->addShader(probeShader);
+            if (!probeProgram->link()) {                            // в кубы рисует полная программа
+                qWarning() << "Probe materials: Failed to link for" << file.fileName() << ":" << probeProgram->log();
+                delete probeProgram;
+                probeProgram = 0;
+            }
+        }
+        if (!probeProgram) {
+            delete probeVariant;
+            probeVariant = 0;
+            probeShader = shader;
         }
+    }
+    m_probeFragmentShaders << probeVariant;
+    m_probePrograms << probeProgram;
 
-        m_fragmentShaders << shader;                    // запихиваем фрагментный шейдер в массив фрагментных шейдеров
-        m_programs << program;                          // программу в массив программ
-        m_renderOptions->addShader(file.baseName());    // имя файлов в массив списка эффектов
+    QGLShaderProgram *layeredProgram = 0;
+    if (m_layeredCubemaps) {                                        // без пары для каждой программы кубы рисуются по граням
+        layeredProgram = linkLayeredProgram(probeShader);           // проход на все грани бывает только в кубы
+        m_layeredCubemaps = (layeredProgram != 0);
+    }
+    m_layeredPrograms << layeredProgram;
+
+    m_fragmentShaders << shader;                    // запихиваем фрагментный шейдер в массив фрагментных шейдеров
+    m_programs << program;                          // программу в массив программ
+    m_renderOptions->addShader(file.baseName());    // имя файлов в массив списка эффектов
+
+    program->bind();                                            // связываем программу (с чем???)
+    m_cubemaps << ((program->uniformLocation("env") != -1)                      // если в шейдерной программе есть переменная "env" то в массив (??? cubemaps)
+                   ? new GLRenderTargetCube(qMin(256, m_maxTextureSize), m_options.cubemapTiers ? 32 : 0) : 0);  // пихаем новый объект (??? карты текстур) либо 0
+    if (m_options.mipmaps && m_cubemaps.last())
+        m_cubemaps.last()->setMipmapped(true);
+    program->release();                                                                     // удаляем уже ненужный экземпляр программы
+    invalidateCubemaps();                                       // в кольце новый куб
+    return true;
+}
 
-        program->bind();                                            // связываем программу (с чем???)
-        m_cubemaps << ((program->uniformLocation("env") != -1)                      // если в шейдерной программе есть переменная "env" то в массив (??? cubemaps)
-                       ? new GLRenderTargetCube(qMin(256, m_maxTextureSize)) : 0);  // пихаем новый объект (??? карты текстур) либо 0
-        program->release();                                                                     // удаляем уже ненужный экземпляр программы
+QGLShaderProgram *Scene::linkLayeredProgram(QGLShader *fragmentShader)
+{
+    QGLShaderProgram *program = new QGLShaderProgram;
+    program->addShader(m_layeredVertexShader);
+    program->addShader(m_cubemapGeometryShader);
+    program->addShader(fragmentShader);
+    program->setGeometryInputType(GL_TRIANGLES);
+    program->setGeometryOutputType(GL_TRIANGLE_STRIP);
+    program->setGeometryOutputVertexCount(18);          // треугольник на каждую грань
+    if (!program->link()) {
+        qWarning("Layered cube maps: Failed to link, rendering one face at a time.");
+        qWarning() << program->log();
+        delete program;
+        return 0;
     }
+    return program;
+}
 
-    if (m_programs.size() == 0)                         // если с программами потерпели фиаско,
-        m_programs << new QGLShaderProgram;             // ???? запихиваем в массив программу по умолчанию
+void Scene::readParameters(int)
+{
+    m_parameters = RenderOptionsDialog::readParameterFiles();
+}
 
-    m_renderOptions->emitParameterChanged();            // отсылаем сигналы изменения параметров отрисовки (для рисования)
+void Scene::mapEnvironmentCache(int)
+{
+    if (m_environmentCache->map(m_environmentCache->fileName(cacheDirectory())) && !m_options.startupTrace.isEmpty())
+        qDebug("Environment: mapped %lld KB from the cache in %lld ms",
+               m_environmentCache->byteCount() / 1024, m_environmentCache->elapsed());
+}
+
+void Scene::decodeEnvironmentFace(int face)
+{
+    if (m_environmentCache && m_environmentCache->isMapped())
+        return;                                                                             // куб возьмём из кэша
+    m_environmentFaces[face] = GLTextureCube::loadFace(m_environmentFiles.at(face), qMin(1024, m_maxTextureSize));
+    if (m_environmentFaces[face].isNull())
+        qWarning() << "Failed to load environment face" << m_environmentFiles.at(face);
+}
+
+void Scene::uploadEnvironment(int)
+{
+    const int size = qMin(1024, m_maxTextureSize);
+    GLTextureCube *environment;
+    if (m_environmentCache && m_environmentCache->isMapped()) {                             // прямо из отображённого файла
+        environment = m_environmentCache->createTextureCube();
+    } else if (m_environmentCache) {                                                        // сжимает драйвер, результат - в кэш
+        environment = m_environmentCache->createTextureCube(m_environmentFaces, m_environmentCache->fileName(cacheDirectory()));
+    } else {
+        environment = new GLTextureCube(size);                                              // создаём куб фона
+        for (int face = 0; face < m_environmentFaces.size(); ++face) {
+            if (!m_environmentFaces[face].isNull())
+                environment->load(size, face, reinterpret_cast<const QRgb *>(m_environmentFaces[face].constBits()));
+        }
+    }
+    delete m_environmentCache;                                                              // данные уже в GL, файл больше не нужен
+    m_environmentCache = 0;
+    if (m_options.mipmaps)
+        environment->setMipmapped(true);
+    delete m_environment;
+    m_environment = environment;
+    m_environmentFaces.clear();
+    clearEnvironmentLayers();
+    invalidateCubemaps();
+}
+
+void Scene::decodeTexture(int index)
+{
+    TextureCacheFile *cache = m_textureCaches.at(index);
+    if (cache && cache->map(cache->fileName(cacheDirectory())))
+        return;                                         // декодировать нечего
+    const int size = qMin(256, m_maxTextureSize);       // m_maxTextureSize определено 1024 в main.cpp, вот только qMin вернёт 256
+    m_textureImages[index] = loadImage(m_textureFiles.at(index).absoluteFilePath(), size);
+    if (m_textureImages[index].isNull())
+        qWarning() << "Failed to load texture" << m_textureFiles.at(index).absoluteFilePath();
+}
+
+void Scene::uploadTexture(int index)
+{
+    TextureCacheFile *cache = m_textureCaches.at(index);
+    const QImage image = m_textureImages[index];
+    m_textureImages[index] = QImage();
+    m_textureCaches[index] = 0;
+    QScopedPointer<TextureCacheFile> cacheDeleter(cache);  // данные уже в GL, файл больше не нужен
+
+    if (image.isNull() && !(cache && cache->isMapped()))
+        return;                                         // так и остаётся заглушка
+    if (m_textureArray) {                               // в свой слой массива
+        m_textureArray->load(index, reinterpret_cast<const QRgb *>(image.constBits()));
+        m_textureArray->updateMipmaps();
+        return;
+    }
+    GLTexture2D *texture;
+    if (cache && cache->isMapped())                     // прямо из отображённого файла
+        texture = cache->createTexture2D();
+    else if (cache)                                     // сжимает драйвер, результат - в кэш
+        texture = cache->createTexture2D(image, cache->fileName(cacheDirectory()));
+    else
+        texture = new GLTexture2D(image);
+    if (texture->failed()) {
+        delete texture;
+    } else {
+        if (m_options.mipmaps)
+            texture->setMipmapped(true);
+        m_textures[index] = texture;
+    }
+}
+
+void Scene::readShaderSource(int index)
+{
+    QFile file(m_shaderFiles.at(index).absoluteFilePath());
+    if (file.open(QIODevice::ReadOnly))
+        m_shaderSources[index] = file.readAll();
+    else
+        qWarning() << "Failed to read shader" << file.fileName();
+}
+
+void Scene::linkShader(int index)
+{
+    if (loadShader(m_shaderFiles.at(index), m_shaderSources.at(index)))
+        m_renderOptions->emitParameterChanged();        // новой программе тоже нужны параметры
+}
+
+void Scene::prepareNoise(int)
+{
+    const int NOISE_SIZE = m_options.noiseSize; // any power of two, the volume always holds one noise period
+    int channels = noiseChannelsSampled(m_shaderSources);
+    m_loadingNoise = new NoiseVolume(NOISE_SIZE, m_options.noiseSeed, 0x20, GLTexture3D::storedChannels(channels));  // R8/RG8 если шейдерам хватает, иначе RGBA
+    if (m_options.useCache)                                                                 // при наличии кэша просто отображаем файл в память
+        m_loadingNoise->loadCache(m_loadingNoise->cacheFileName(cacheDirectory()));
+    if (!m_options.startupTrace.isEmpty())
+        qDebug("Noise volume: %d^3, shaders sample %d channel(s), texture uses %d, %lld KB%s",
+               NOISE_SIZE, channels, m_loadingNoise->channels(), m_loadingNoise->byteCount() / 1024,
+               m_loadingNoise->isCached() ? qPrintable(QString(", mapped from the cache in %1 ms").arg(m_loadingNoise->elapsed())) : "");
+}
+
+void Scene::renderGpuNoise(int)
+{
+    const int size = m_loadingNoise->size();
+    GLRenderTarget3D *target = new GLRenderTarget3D(size, size, size, m_loadingNoise->channels());
+    GpuNoiseVolume gpuNoise(size, m_options.noiseSeed);
+    GLTexture3D *noise = target;
+    const bool generate = !m_loadingNoise->isCached();     // CPU считает только для запасного пути и для проверки
+    const bool rendered = gpuNoise.render(target);
+    if (!rendered) {
+        qWarning("Noise volume: GPU generation failed, generating on the CPU.");
+        delete target;
+        noise = new GLTexture3D(size, size, size, m_loadingNoise->channels());
+        if (generate)
+            m_loadingNoise->generate();
+        noise->load(size, size, size, m_loadingNoise->data());
+    } else if (!m_options.startupTrace.isEmpty()) {
+        qDebug("Noise volume: rendered on the GPU in %lld ms", gpuNoise.elapsed());
+    }
+    if (rendered && m_options.verifyGpuNoise) {                                      // для проверки GPU считаем и на CPU
+        if (generate)
+            m_loadingNoise->generate();
+        qint64 mismatches = 0;
+        int difference = GpuNoiseVolume::compare(noise, *m_loadingNoise, &mismatches);
+        qDebug("Noise volume: GPU differs from CPU in %lld of %lld values, by at most %d (tolerance %d)",
+               mismatches, m_loadingNoise->byteCount(), difference, int(GpuNoiseVolume::Tolerance));
+        if (difference > GpuNoiseVolume::Tolerance)
+            qWarning("Noise volume: GPU result is outside the tolerance.");
+    }
+    if (generate && m_loadingNoise->data() && !m_options.startupTrace.isEmpty())
+        qDebug("Noise volume: generated on the CPU in %lld ms using %d thread(s)",
+               m_loadingNoise->elapsed(), m_loadingNoise->threadCount());
+    if (m_options.mipmaps)
+        noise->setMipmapped(true);
+    delete m_noise;
+    m_noise = noise;
+    invalidateCubemaps();                                   // в кубах боксы ещё с заглушкой шума
+    delete m_loadingNoise;
+    m_loadingNoise = 0;
+}
+
+// Текстура, файл кэша и кольцо буферов под слои. Каждый буфер отображён в
+// память до загрузки своего слоя, рабочие потоки пишут прямо в него.
+void Scene::beginNoiseUpload(int)
+{
+    const int size = m_loadingNoise->size();
+    m_loadingNoiseTexture = new GLTexture3D(size, size, size, m_loadingNoise->channels());
+    if (m_loadingNoise->isCached()) {                       // слои не считаются, объём уже в памяти
+        m_loadingNoiseTexture->load(size, size, size, m_loadingNoise->data());
+        return;
+    }
+    if (m_options.useCache) {
+        m_noiseCacheFile = new QSaveFile(m_loadingNoise->cacheFileName(cacheDirectory()));
+        if (!m_loadingNoise->beginCacheFile(*m_noiseCacheFile)) {
+            delete m_noiseCacheFile;
+            m_noiseCacheFile = 0;
+        }
+    }
+    // кэш пишется из буферов, а читать отображённый буфер GL медленно: тогда буферы в памяти
+    const int slabBytes = int(qint64(m_noiseSlabDepth) * size * size * m_loadingNoise->channels());
+    for (int slot = 0; slot < m_noiseRing.size(); ++slot) {
+        m_noiseRing[slot] = new GLPixelUnpackBuffer(slabBytes, !m_noiseCacheFile);
+        m_noiseSlots[slot] = static_cast<uchar *>(m_noiseRing[slot]->lock());
+    }
+}
+
+void Scene::generateNoiseSlab(int slab)
+{
+    if (m_loadingNoise->isCached())
+        return;
+    const int zBegin = slab * m_noiseSlabDepth;
+    const int zEnd = qMin(zBegin + m_noiseSlabDepth, m_loadingNoise->size());
+    m_loadingNoise->generateSlab(zBegin, zEnd, m_noiseSlots.at(slab % m_noiseSlots.size()));
+}
+
+// Слои приходят строго по порядку (каждая загрузка ждёт предыдущую), поэтому
+// файл кэша пишется подряд, а буфер слоя сразу отдаётся слою на круг дальше.
+void Scene::uploadNoiseSlab(int slab)
+{
+    const int size = m_loadingNoise->size();
+    if (!m_loadingNoise->isCached()) {
+        const int slot = slab % m_noiseRing.size();
+        const int zBegin = slab * m_noiseSlabDepth;
+        const int depth = qMin(m_noiseSlabDepth, size - zBegin);
+        GLPixelUnpackBuffer *buffer = m_noiseRing.at(slot);
+        if (m_noiseCacheFile)
+            m_noiseCacheFile->write(reinterpret_cast<const char *>(m_noiseSlots.at(slot)),
+                                    qint64(depth) * size * size * m_loadingNoise->channels());
+        buffer->unlock();
+        m_loadingNoiseTexture->loadSlab(zBegin, depth, buffer->bind());
+        buffer->unbind();
+        if (slab + m_noiseRing.size() < m_noiseSlabCount)
+            m_noiseSlots[slot] = static_cast<uchar *>(buffer->lock());
+    }
+
+    if (slab == m_noiseSlabCount - 1) {                     // последний слой: текстура готова, меняем заглушку
+        if (m_noiseCacheFile && !m_noiseCacheFile->commit())
+            qWarning() << "Noise volume: Failed to write" << m_noiseCacheFile->fileName() << m_noiseCacheFile->errorString();
+        delete m_noiseCacheFile;
+        m_noiseCacheFile = 0;
+        if (m_options.mipmaps)                              // шум в granite.fsh читается в нескольких масштабах
+            m_loadingNoiseTexture->setMipmapped(true);
+        delete m_noise;
+        m_noise = m_loadingNoiseTexture;
+        m_loadingNoiseTexture = 0;
+        invalidateCubemaps();                               // в кубах боксы ещё с заглушкой шума
+        delete m_loadingNoise;
+        m_loadingNoise = 0;
+        qDeleteAll(m_noiseRing);
+        m_noiseRing.clear();
+        m_noiseSlots.clear();
+    }
+}
+
+QString Scene::cacheDirectory() const
+{
+    if (!m_options.cacheDirectory.isEmpty())
+        return m_options.cacheDirectory;
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
 }
 
 static void loadMatrix(const QMatrix4x4& m)             //// грузим массив данных из матрицы одного типа в другой
@@ -275,23 +886,44 @@ static void loadMatrix(const QMatrix4x4& m)             //// грузим мас
     glLoadMatrixf(mat);                             // грузим массив данных из матрицы одного типа в другой (зачем????)
 }
 
+// Лежит ли шар с центром в координатах камеры хотя бы частью внутри пирамиды
+// видимости 'projection': плоскости граней - сумма и разность строк матрицы
+static bool sphereInFrustum(const QMatrix4x4 &projection, const QVector3D &center, float radius)
+{
+    for (int i = 0; i < 3; ++i) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            const QVector4D plane = projection.row(3) + sign * projection.row(i);
+            const QVector3D normal = plane.toVector3D();
+            if (QVector3D::dotProduct(normal, center) + plane.w() < -radius * normal.length())
+                return false;
+        }
+    }
+    return true;
+}
+
 /// Рисуем все кубики разом
 // If one of the boxes should not be rendered, set excludeBox to its index.
 // If the main box should not be rendered, set excludeBox to -1.
-void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
+// With 'projection', boxes whose bounding spheres lie outside its frustum are skipped.
+void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox, const QMatrix4x4 *projection)
 {
     QMatrix4x4 invView = view.inverted();           //
+    GLTexture *texture = m_textures[m_currentTexture];
+    if (m_textureArray)                             // один массив на все текстуры, слой выбирает шейдер
+        texture = m_textureArray;
+    else if (!texture)                              // ещё грузится в фоне
+        texture = m_placeholderTexture;
     //excludeBox=2;
 
     // If multi-texturing is supported, use three saplers.
     //if (glActiveTexture) {                  // старьё выкидываем
         glActiveTexture(GL_TEXTURE0);
-        m_textures[m_currentTexture]->bind();
+        texture->bind();
         glActiveTexture(GL_TEXTURE2);
         m_noise->bind();
         glActiveTexture(GL_TEXTURE1);
     /*} else {
-        m_textures[m_currentTexture]->bind();
+        texture->bind();
     }*/
 
     glDisable(GL_LIGHTING);
@@ -307,14 +939,20 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
     // РИСУЕМ ФОН
     // Don't render the environment if the environment texture can't be set for the correct sampler.
     // if (glActiveTexture) {  // старьё выкидываем
+    if (m_boxLayers & EnvironmentLayer) {               // иначе фон уже скопирован в грань
+        QGLShaderProgram *environmentProgram = (m_layeredPass ? m_layeredEnvironmentProgram : m_environmentProgram);
         m_environment->bind();
-        m_environmentProgram->bind();
-        m_environmentProgram->setUniformValue("tex", GLint(0));
-        m_environmentProgram->setUniformValue("env", GLint(1));
-        m_environmentProgram->setUniformValue("noise", GLint(2));
+        environmentProgram->bind();
+        environmentProgram->setUniformValue("tex", GLint(0));
+        environmentProgram->setUniformValue("env", GLint(1));
+        environmentProgram->setUniformValue("noise", GLint(2));
+        if (m_layeredPass)
+            environmentProgram->setUniformValueArray("faceTransforms", m_faceTransforms, 6);
         m_box->draw();
-        m_environmentProgram->release();
+        ++m_drawCalls;
+        environmentProgram->release();
         m_environment->unbind();
+    }
     //}
 
     loadMatrix(view);
@@ -323,10 +961,20 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
     glEnable(GL_LIGHTING);
 
     // РИСУЕМ КРУГ ИЗ КУБОВ, по одному на каждую шейдерную программу
-    for (int i = 0; i < m_programs.size(); ++i) {
+    for (int i = 0; i < m_programs.size() && (m_boxLayers & BoxLayer); ++i) {
         if (i == excludeBox)
             continue;
 
+        if (projection) {                           // шар вокруг бокса, сжатого до 0.3 x 0.6 x 0.6
+            const float angle = 2.0f * PI * i / m_programs.size();
+            const QVector3D center = m_trackBalls[1].rotation().rotatedVector(
+                QVector3D(2.0f * std::cos(angle), 2.0f * std::sin(angle), 0.0f));
+            if (!sphereInFrustum(*projection, view * center, 0.6f * m_box->boundingRadius())) {
+                ++m_culledDraws;
+                continue;
+            }
+        }
+
         glPushMatrix();
         QMatrix4x4 m;
         m.rotate(m_trackBalls[1].rotation());
@@ -342,14 +990,20 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
             else
                 m_environment->bind();
         //}
-        m_programs[i]->bind();
-        m_programs[i]->setUniformValue("tex", GLint(0));
-        m_programs[i]->setUniformValue("env", GLint(1));
-        m_programs[i]->setUniformValue("noise", GLint(2));
-        m_programs[i]->setUniformValue("view", view);
-        m_programs[i]->setUniformValue("invView", invView);
+        QGLShaderProgram *program = boxProgram(i);
+        program->bind();
+        program->setUniformValue("tex", GLint(0));
+        program->setUniformValue("env", GLint(1));
+        program->setUniformValue("noise", GLint(2));
+        if (m_textureArray)
+            program->setUniformValue("texLayer", GLfloat(m_currentTexture));
+        if (m_layeredPass)
+            program->setUniformValueArray("faceTransforms", m_faceTransforms, 6);
+        program->setUniformValue("view", view);
+        program->setUniformValue("invView", invView);
         m_box->draw();
-        m_programs[i]->release();
+        ++m_drawCalls;
+        program->release();
 
         // if (glActiveTexture) {  // старьё выкидываем
             if (m_dynamicCubemap && m_cubemaps[i])
@@ -361,7 +1015,12 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
     }
 
     // РИСУЕМ ГЛАВНЫЙ КУБ
-    if (-1 != excludeBox) {
+    bool mainBoxVisible = (-1 != excludeBox) && (m_boxLayers & BoxLayer);
+    if (mainBoxVisible && projection && !sphereInFrustum(*projection, view * QVector3D(), m_box->boundingRadius())) {
+        mainBoxVisible = false;
+        ++m_culledDraws;
+    }
+    if (mainBoxVisible) {
         QMatrix4x4 m;
         m.rotate(m_trackBalls[0].rotation()); //  получаем текущую матрицу поворота
         glMultMatrixf(m.constData());
@@ -373,14 +1032,20 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
                 m_environment->bind();
         //}
 
-        m_programs[m_currentShader]->bind();
-        m_programs[m_currentShader]->setUniformValue("tex", GLint(0));
-        m_programs[m_currentShader]->setUniformValue("env", GLint(1));
-        m_programs[m_currentShader]->setUniformValue("noise", GLint(2));
-        m_programs[m_currentShader]->setUniformValue("view", view);
-        m_programs[m_currentShader]->setUniformValue("invView", invView);
+        QGLShaderProgram *program = boxProgram(m_currentShader);
+        program->bind();
+        program->setUniformValue("tex", GLint(0));
+        program->setUniformValue("env", GLint(1));
+        program->setUniformValue("noise", GLint(2));
+        if (m_textureArray)
+            program->setUniformValue("texLayer", GLfloat(m_currentTexture));
+        if (m_layeredPass)
+            program->setUniformValueArray("faceTransforms", m_faceTransforms, 6);
+        program->setUniformValue("view", view);
+        program->setUniformValue("invView", invView);
         m_box->draw();
-        m_programs[m_currentShader]->release();
+        ++m_drawCalls;
+        program->release();
 
         // if (glActiveTexture) {  // старьё выкидываем
             if (m_dynamicCubemap)
@@ -395,7 +1060,17 @@ void Scene::renderBoxes(const QMatrix4x4 &view, int excludeBox)
         m_noise->unbind();
         glActiveTexture(GL_TEXTURE0);
     //}
-    m_textures[m_currentTexture]->unbind();
+    texture->unbind();
+}
+
+// В кубы отражений - программы с упрощёнными материалами, если они есть
+QGLShaderProgram *Scene::boxProgram(int index) const
+{
+    if (m_layeredPass)
+        return m_layeredPrograms[index];
+    if (m_probePass && m_probePrograms.value(index))
+        return m_probePrograms[index];
+    return m_programs[index];
 }
 
 void Scene::setStates()
@@ -463,59 +1138,188 @@ void Scene::defaultStates()
 
 void Scene::renderCubemaps()
 {
-    // To speed things up, only update the cubemaps for the small cubes every N frames.
-    const int N = (m_updateAllCubemaps ? 1 : 3);
-
-    QMatrix4x4 mat;
-    GLRenderTargetCube::getProjectionMatrix(mat, 0.1f, 100.0f);
+    GLRenderTargetCube::getProjectionMatrix(m_cubemapProjection, 0.1f, 100.0f);
+    for (int face = 0; face < 6; ++face) {          // для прохода на все грани сразу
+        QMatrix4x4 rotation;
+        GLRenderTargetCube::getViewMatrix(rotation, face);
+        m_faceTransforms[face] = m_cubemapProjection * rotation;
+    }
 
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
-    loadMatrix(mat);
+    loadMatrix(m_cubemapProjection);
 
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
 
-    QVector3D center;
+    // что сдвинулось с прошлого кадра: кольцо видят все кубы, центральный куб - только кубы кольца
+    const QQuaternion boxRotation = m_trackBalls[0].rotation();
+    const QQuaternion ringRotation = m_trackBalls[1].rotation();
+    if (!qFuzzyCompare(ringRotation, m_cubemapRotations[1]))
+        invalidateCubemaps();
+    else if (!qFuzzyCompare(boxRotation, m_cubemapRotations[0]))
+        invalidateCubemaps(true);
+    m_cubemapRotations[0] = boxRotation;
+    m_cubemapRotations[1] = ringRotation;
+
+    // центры кубов и их вес на экране: размер, делённый на расстояние до камеры
+    QVector<QVector3D> centers(m_cubemaps.size() + 1);     // 0 - центральный куб, i + 1 - куб кольца i
+    const QVector3D eye = m_trackBalls[2].rotation().conjugate().rotatedVector(
+        QVector3D(0.0f, 0.0f, 2.0f * std::exp(m_distExp / 1200.0f)));
+    // вес в пикселях экрана при угле обзора 60°: грань куба примерно с сам куб на экране
+    const float pixelsPerUnit = float(height()) / std::tan(PI / 6.0f);
+    m_cubemapScheduler->setProbeCount(centers.size());
+    const float mainScreenSize = 1.0f / qMax(0.1f, eye.length());
+    m_mainCubemap->setTier(m_mainCubemap->tierFor(mainScreenSize * pixelsPerUnit));
+    m_cubemapScheduler->setProbe(0, m_mainCubemap->size(), mainScreenSize);
+    for (int i = 0; i < m_cubemaps.size(); ++i) {
+        float angle = 2.0f * PI * i / m_cubemaps.size();
+        centers[i + 1] = ringRotation.rotatedVector(QVector3D(std::cos(angle), std::sin(angle), 0.0f));
+        const float screenSize = 0.6f / qMax(0.1f, (eye - centers[i + 1]).length());
+        if (m_cubemaps[i])                                  // ярус сменился - планировщик перерисует куб целиком
+            m_cubemaps[i]->setTier(m_cubemaps[i]->tierFor(screenSize * pixelsPerUnit));
+        m_cubemapScheduler->setProbe(i + 1, m_cubemaps[i] ? m_cubemaps[i]->size() : 0, screenSize);
+    }
 
-    for (int i = m_frame % N; i < m_cubemaps.size(); i += N) {
-        if (0 == m_cubemaps[i])
-            continue;
+    // фон для размеров граней, которых больше нет, не нужен
+    QHash<int, GLRenderTargetCube *>::iterator layer = m_environmentLayers.begin();
+    while (layer != m_environmentLayers.end()) {
+        bool used = (layer.key() == m_mainCubemap->size());
+        for (int i = 0; i < m_cubemaps.size() && !used; ++i)
+            used = (m_cubemaps[i] && m_cubemaps[i]->size() == layer.key());
+        if (used) {
+            ++layer;
+        } else {
+            delete layer.value();
+            layer = m_environmentLayers.erase(layer);
+        }
+    }
 
-        float angle = 2.0f * PI * i / m_cubemaps.size();
+    // чистые кубы пропускаем, устаревшие - по важности, пока хватает бюджета
+    const QVector<CubemapScheduler::Update> updates = m_cubemapScheduler->schedule(m_updateAllCubemaps);
+    if (!updates.isEmpty()) {
+        m_cubemapScheduler->beginTiming();
+        foreach (const CubemapScheduler::Update &update, updates) {
+            if (update.probe == 0)
+                renderCubemap(m_mainCubemap, centers[0], -1, update.face);
+            else
+                renderCubemap(m_cubemaps[update.probe - 1], centers[update.probe], update.probe - 1, update.face);
+            m_cubemapScheduler->rendered(update);
+        }
+        m_cubemapScheduler->endTiming();
+    }
+
+    glPopMatrix();
 
-        center = m_trackBalls[1].rotation().rotatedVector(QVector3D(std::cos(angle), std::sin(angle), 0.0f));
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
 
-        for (int face = 0; face < 6; ++face) {
-            m_cubemaps[i]->begin(face);
+    m_updateAllCubemaps = false;
+}
 
-            GLRenderTargetCube::getViewMatrix(mat, face);
-            QVector4D v = QVector4D(-center.x(), -center.y(), -center.z(), 1.0);
-            mat.setColumn(3, mat * v);
+// Кубы, которые видят изменение: все или только кубы кольца (изменился центральный куб)
+void Scene::invalidateCubemaps(bool ringOnly)
+{
+    if (!m_cubemapScheduler)
+        return;
+    if (!ringOnly) {
+        m_cubemapScheduler->invalidateAll();
+        return;
+    }
+    for (int probe = 1; probe < m_cubemapScheduler->probeCount(); ++probe)
+        m_cubemapScheduler->invalidate(probe);
+}
 
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            renderBoxes(mat, i);
+// Вид из 'center': грань 'face' или, при -1, все шесть. При m_layeredCubemaps
+// все шесть граней за один проход, поворот и проекцию каждой грани добавляет
+// cubemap.gsh, иначе по граням.
+void Scene::renderCubemap(GLRenderTargetCube *target, const QVector3D &center, int excludeBox, int face)
+{
+    // готовый фон копируется в грани, поверх рисуются только боксы
+    GLRenderTargetCube *layer = environmentLayer(target->size());
+    if (layer)
+        target->copyFrom(layer, face);
+    const GLbitfield clearBits = (layer ? GL_DEPTH_BUFFER_BIT : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    m_boxLayers = (layer ? int(BoxLayer) : int(AllLayers));
+    m_probePass = true;                             // материалы попроще
 
-            m_cubemaps[i]->end();
+    QMatrix4x4 mat;
+    if (face < 0 && m_layeredCubemaps) {
+        target->beginLayered();
+        if (target->isComplete()) {
+            mat.translate(-center);
+            glClear(clearBits);
+            m_layeredPass = true;
+            renderBoxes(mat, excludeBox);
+            m_layeredPass = false;
+            target->end();
+            m_boxLayers = AllLayers;
+            m_probePass = false;
+            return;
         }
+        target->end();
+        qWarning("Layered cube maps: The frame buffer is incomplete, rendering one face at a time.");
+        m_layeredCubemaps = false;
     }
 
-    for (int face = 0; face < 6; ++face) {
-        m_mainCubemap->begin(face);
-        GLRenderTargetCube::getViewMatrix(mat, face);
+    for (int f = (face < 0 ? 0 : face); f < (face < 0 ? 6 : face + 1); ++f) {
+        target->begin(f);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        renderBoxes(mat, -1);
+        GLRenderTargetCube::getViewMatrix(mat, f);
+        QVector4D v = QVector4D(-center.x(), -center.y(), -center.z(), 1.0);
+        mat.setColumn(3, mat * v);
 
-        m_mainCubemap->end();
-    }
+        glClear(clearBits);
+        renderBoxes(mat, excludeBox, &m_cubemapProjection);     // боксы вне грани пропускаются
 
-    glPopMatrix();
+        target->end();
+    }
+    m_boxLayers = AllLayers;
+    m_probePass = false;
+}
 
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
+// Фон вокруг куба: renderBoxes() рисует его без сдвига камеры, так что он
+// одинаков для всех кубов с гранью 'size' и рисуется один раз на размер.
+// Без копирования между буферами кадра - 0, и фон рисуется в каждую грань.
+GLRenderTargetCube *Scene::environmentLayer(int size)
+{
+    if (!m_options.cubemapEnvironmentLayer || !GLRenderTargetCube::isCopySupported())
+        return 0;
+    if (m_suspendedLayers.contains(size))
+        return 0;
+    GLRenderTargetCube *layer = m_environmentLayers.value(size);
+    if (layer)
+        return layer;
+
+    layer = new GLRenderTargetCube(size);
+    QMatrix4x4 mat;
+    bool complete = !layer->failed();
+    m_boxLayers = EnvironmentLayer;
+    for (int face = 0; face < 6 && complete; ++face) {
+        layer->begin(face);
+        complete = layer->isComplete();
+        if (complete) {
+            GLRenderTargetCube::getViewMatrix(mat, face);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderBoxes(mat);
+        }
+        layer->end();
+    }
+    m_boxLayers = AllLayers;
+    if (!complete || layer->failed()) {
+        qWarning("Cube map environment: The frame buffer is incomplete, drawing the environment into every face.");
+        delete layer;
+        m_options.cubemapEnvironmentLayer = false;
+        return 0;
+    }
+    m_environmentLayers.insert(size, layer);
+    return layer;
+}
 
-    m_updateAllCubemaps = false;
+void Scene::clearEnvironmentLayers()
+{
+    qDeleteAll(m_environmentLayers);
+    m_environmentLayers.clear();
 }
 
 void Scene::drawBackground(QPainter *painter, const QRectF &)
@@ -524,11 +1328,46 @@ void Scene::drawBackground(QPainter *painter, const QRectF &)
     float height = float(painter->device()->height());
 
     painter->beginNativePainting();
+    if (m_startup) {                        // догружаем то, что готово, не больше ~8 мс GL работы за кадр
+        m_startup->runContextTasks(8);
+        if (m_startup->isFinished())
+            finishStartup();
+    }
+    if (m_textureStreamer)                  // новые текстуры из каталога, не больше ~2 мс за кадр
+        m_textureStreamer->process(2);
+    enforceTextureBudget();
     setStates();
+    if (m_options.benchmarkMinification && !m_startup) {    // замер один раз, когда всё загружено
+        m_options.benchmarkMinification = false;
+        benchmarkMinification();
+    }
+    if (m_options.benchmarkTextureCache && !m_startup) {
+        m_options.benchmarkTextureCache = false;
+        benchmarkTextureCache();
+    }
+    if (m_options.benchmarkCubemaps && !m_startup) {
+        m_options.benchmarkCubemaps = false;
+        benchmarkCubemaps();
+    }
 
     if (m_dynamicCubemap)
         renderCubemaps();
 
+    // внеэкранный кадр: цель пересоздаётся при изменении размера окна
+    if (m_options.offscreen && (!m_offscreenTarget || m_offscreenTarget->width() != int(width)
+                                || m_offscreenTarget->height() != int(height))) {
+        delete m_offscreenTarget;
+        m_offscreenTarget = new GLRenderTarget2D(int(width), int(height), m_options.offscreenSamples);
+        if (m_offscreenTarget->failed()) {
+            qWarning("Offscreen rendering: Render targets are not available, drawing into the window.");
+            delete m_offscreenTarget;
+            m_offscreenTarget = 0;
+            m_options.offscreen = false;
+        }
+    }
+
+    if (m_offscreenTarget)
+        m_offscreenTarget->begin();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     glMatrixMode(GL_PROJECTION);
@@ -536,17 +1375,272 @@ void Scene::drawBackground(QPainter *painter, const QRectF &)
 
     glMatrixMode(GL_MODELVIEW);
 
+    QMatrix4x4 projection;                  // та же проекция, для отсечения боксов
+    projection.perspective(60.0f, width / height, 0.01f, 15.0f);
     QMatrix4x4 view;
     view.rotate(m_trackBalls[2].rotation());
     view(2, 3) -= 2.0f * std::exp(m_distExp / 1200.0f);
-    renderBoxes(view);
+    renderBoxes(view, -2, &projection);
+
+    if (m_offscreenTarget) {
+        m_offscreenTarget->end();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawOffscreenTarget();
+        if (!m_options.offscreenCapture.isEmpty() && !m_startup) {     // снимок один раз, когда всё загружено
+            if (m_offscreenTarget->toImage().save(m_options.offscreenCapture))
+                qDebug() << "Offscreen rendering: Saved the view to" << m_options.offscreenCapture;
+            else
+                qWarning() << "Offscreen rendering: Failed to save the view to" << m_options.offscreenCapture;
+            m_options.offscreenCapture.clear();
+        }
+    }
 
     defaultStates();
+    if (m_frame == 0 && !m_options.startupTrace.isEmpty()) {   // glFinish только ради замера
+        glFinish();
+        qDebug("Startup: first frame after %lld ms, %d task(s) still loading",
+               m_startupTimer.elapsed(), m_startup ? m_startup->unfinishedCount() : 0);
+    }
     ++m_frame;
 
     painter->endNativePainting();
 }
 
+// Covers the window with the offscreen target, unlit and without depth.
+void Scene::drawOffscreenTarget()
+{
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+
+    glActiveTexture(GL_TEXTURE0);
+    m_offscreenTarget->bind();
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+    glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+    glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
+    glEnd();
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    m_offscreenTarget->unbind();
+
+    glEnable(GL_DEPTH_TEST);                    // как после setStates()
+    glEnable(GL_LIGHTING);
+    glEnable(GL_CULL_FACE);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+}
+
+// Draws the scene into a 512x512 offscreen target from the default and the
+// farther zoom levels the mouse wheel allows, first with every texture single
+// level and then mipmapped, and prints the time per frame and the fragment
+// rate. Dynamic cube maps are left out, they would only repeat the same
+// measurement at a smaller size.
+void Scene::benchmarkMinification()
+{
+    const int FRAMES = 20;
+    const int distances[] = {0, 600, 900, 1200};        // m_distExp: 600 - по умолчанию, 1200 - дальше колесом уже нельзя
+
+    GLRenderTarget2D target(512, 512);
+    if (target.failed()) {
+        qWarning("Minification benchmark: Render targets are not available.");
+        return;
+    }
+
+    QList<GLTexture *> textures;
+    textures << m_noise << m_environment << m_placeholderTexture;
+    if (m_textureArray)
+        textures << m_textureArray;
+    foreach (GLTexture *texture, m_textures)
+        if (texture) textures << texture;
+    QList<bool> mipmapped;
+    foreach (GLTexture *texture, textures)
+        mipmapped << texture->isMipmapped();
+    const bool dynamicCubemap = m_dynamicCubemap;
+    m_dynamicCubemap = false;
+
+    GLuint query = 0;
+    if (getGLExtensionFunctions().occlusionQuerySupported())
+        glGenQueries(1, &query);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    qgluPerspective(60.0, 1.0, 0.01, 15.0);
+    glMatrixMode(GL_MODELVIEW);
+
+    for (int mipmaps = 0; mipmaps < 2; ++mipmaps) {
+        bool ok = true;
+        foreach (GLTexture *texture, textures)
+            ok &= texture->setMipmapped(mipmaps);
+        if (!ok)
+            break;
+
+        for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); ++i) {
+            QMatrix4x4 view;
+            view.rotate(m_trackBalls[2].rotation());
+            view(2, 3) -= 2.0f * std::exp(distances[i] / 1200.0f);
+
+            target.begin();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            renderBoxes(view);                          // прогрев: шейдеры, загрузка текстур в видеопамять
+            glFinish();
+
+            QElapsedTimer timer;
+            timer.start();
+            if (query)
+                glBeginQuery(GL_SAMPLES_PASSED, query);
+            for (int frame = 0; frame < FRAMES; ++frame) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                renderBoxes(view);
+            }
+            if (query)
+                glEndQuery(GL_SAMPLES_PASSED);
+            glFinish();
+            const qint64 elapsed = timer.nsecsElapsed();
+            GLuint samples = 0;
+            if (query)
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+            target.end();
+
+            qDebug("Minification benchmark: %-12s camera at %5.2f: %7.3f ms/frame, %8.1f Mfragments/s",
+                   mipmaps ? "mipmapped," : "one level,", 2.0f * std::exp(distances[i] / 1200.0f),
+                   elapsed / 1e6 / FRAMES, samples * 1e3 / elapsed);
+        }
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    if (query)
+        glDeleteQueries(1, &query);
+    for (int i = 0; i < textures.size(); ++i)
+        textures[i]->setMipmapped(mipmapped[i]);
+    m_dynamicCubemap = dynamicCubemap;
+}
+
+// Loads every box texture and the environment twice: decoded from the image
+// files and uploaded as BGRA, as without --texture-cache, and mapped from the
+// texture cache and uploaded as stored. Prints the time until each upload has
+// finished and the bytes uploaded, which is what the texture occupies. Files
+// missing from the cache are built first, outside the timing. Decoding runs
+// on this thread only, so the startup graph spreads the first column over
+// the worker threads.
+void Scene::benchmarkTextureCache()
+{
+    QList<TextureCacheFile *> caches;
+    foreach (const QFileInfo &file, m_textureFiles)
+        caches << new TextureCacheFile(file.baseName(), QStringList(file.absoluteFilePath()), qMin(256, m_maxTextureSize));
+    caches << new TextureCacheFile("environment", m_environmentFiles, qMin(1024, m_maxTextureSize));
+
+    qDebug("Texture cache benchmark (%s):", TextureCacheFile::compressionSupported()
+           ? "S3TC compression" : "no S3TC support, the cache holds BGRA");
+    double decodeTotal = 0.0, cacheTotal = 0.0;
+    qint64 decodeBytes = 0, cacheBytes = 0;
+    foreach (TextureCacheFile *cache, caches) {
+        const int size = cache->size();
+        const bool cube = cache->faceCount() == 6;
+        const QString fileName = cache->fileName(cacheDirectory());
+
+        // как без кэша: декодирование, масштабирование и BGRA
+        QElapsedTimer timer;
+        timer.start();
+        QVector<QImage> images;
+        foreach (const QString &source, cache->sources())
+            images << loadImage(source, size);
+        GLTexture *texture;
+        if (cube) {
+            GLTextureCube *cubeTexture = new GLTextureCube(size);
+            for (int face = 0; face < images.size(); ++face)
+                cubeTexture->load(size, face, reinterpret_cast<const QRgb *>(images.at(face).constBits()));
+            texture = cubeTexture;
+        } else {
+            GLTexture2D *planeTexture = new GLTexture2D(size, size);
+            planeTexture->load(size, size, reinterpret_cast<const QRgb *>(images.first().constBits()));
+            texture = planeTexture;
+        }
+        glFinish();
+        const double decodeMs = timer.nsecsElapsed() / 1000000.0;
+        delete texture;
+
+        // кэш: собрать, если его нет, потом отображение и загрузка как есть
+        if (!cache->map(fileName)) {
+            if (cube)
+                delete cache->createTextureCube(images, fileName);
+            else
+                delete cache->createTexture2D(images.first(), fileName);
+        }
+        timer.restart();
+        if (!cache->map(fileName)) {
+            qWarning() << "  " << cache->name() << ": the cache file could not be written.";
+            continue;
+        }
+        texture = cube ? static_cast<GLTexture *>(cache->createTextureCube()) : cache->createTexture2D();
+        glFinish();
+        const double cacheMs = timer.nsecsElapsed() / 1000000.0;
+        delete texture;
+
+        const qint64 bytes = qint64(size) * size * 4 * cache->faceCount();
+        const char *format = cache->format() == GL_BGRA ? "BGRA"
+            : cache->format() == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? "DXT1" : "DXT5";
+        qDebug("  %-12s decode + upload %7.2f ms %6lld KB | cache %7.2f ms %6lld KB %s",
+               qPrintable(cache->name()), decodeMs, bytes / 1024, cacheMs, cache->byteCount() / 1024, format);
+        decodeTotal += decodeMs;
+        cacheTotal += cacheMs;
+        decodeBytes += bytes;
+        cacheBytes += cache->byteCount();
+    }
+    qDebug("  %-12s decode + upload %7.2f ms %6lld KB | cache %7.2f ms %6lld KB",
+           "total", decodeTotal, decodeBytes / 1024, cacheTotal, cacheBytes / 1024);
+    qDeleteAll(caches);
+}
+
+// Updates all dynamic cube maps a number of times, first one face at a time
+// and then, where supported, all six faces in one pass, and prints the time
+// and the draw calls per update, and the draws frustum culling skipped.
+void Scene::benchmarkCubemaps()
+{
+    const int FRAMES = 20;
+    const bool layeredCubemaps = m_layeredCubemaps;
+
+    for (int layered = 0; layered < (layeredCubemaps ? 2 : 1); ++layered) {
+        m_layeredCubemaps = layered;
+        m_updateAllCubemaps = true;
+        renderCubemaps();                           // прогрев
+        glFinish();
+
+        const int drawCalls = m_drawCalls;
+        const int culledDraws = m_culledDraws;
+        QElapsedTimer timer;
+        timer.start();
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            m_updateAllCubemaps = true;
+            renderCubemaps();
+        }
+        glFinish();
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        qDebug("Cube map benchmark: %-14s %7.3f ms/update, %4d draw calls/update, %4d culled/update",
+               layered ? "one pass," : "face by face,", elapsed / 1e6 / FRAMES, (m_drawCalls - drawCalls) / FRAMES,
+               (m_culledDraws - culledDraws) / FRAMES);
+    }
+    if (!layeredCubemaps)
+        qDebug("Cube map benchmark: Layered rendering is not available, nothing to compare.");
+
+    m_layeredCubemaps = layeredCubemaps && m_layeredCubemaps;   // проход мог отключиться из-за неполного буфера
+    m_updateAllCubemaps = true;
+}
+
 // ArcBall Rotation
 // http://pmg.org.ru/nehe/nehe48.htm
 // масштабируем, координаты мыши из диапазона [0…ширина], [0...высота] в диапазон [-1...1], [1...-1]
@@ -689,14 +1783,182 @@ void Scene::keyPressEvent(QKeyEvent *event)
 
 void Scene::setShader(int index)
 {
-    if (index >= 0 && index < m_fragmentShaders.size())
+    if (index >= 0 && index < m_fragmentShaders.size()) {
         m_currentShader = index;
+        invalidateCubemaps(true);                   // центральный куб виден только кубам кольца
+    }
 }
 
 void Scene::setTexture(int index)
 {
-    if (index >= 0 && index < m_textures.size())
+    if (index >= 0 && index < m_textures.size()) {
         m_currentTexture = index;
+        invalidateCubemaps();                       // текстура у всех кубов общая
+        m_overTextureBudget = false;                // прежнюю текущую теперь можно выгрузить
+        if (m_evictedTextures.contains(index))      // пока грузится, рисуется заглушка
+            reloadTexture(index);
+    }
+}
+
+// Новые .png в каталоге получают место в списке текстур сразу, а сама текстура
+// приходит через несколько кадров. Файл, который не прочитался (например, ещё
+// не дописан), пробуем снова при следующем изменении каталога.
+void Scene::textureDirectoryChanged(const QString &path)
+{
+    const int size = qMin(256, m_maxTextureSize);
+    foreach (QFileInfo file, QDir(path).entryInfoList(QStringList("*.png"), QDir::Files | QDir::Readable)) {
+        int index = m_streamedTextures.value(file.absoluteFilePath(), -1);
+        if (index < 0) {
+            index = m_textures.size();
+            m_textures << 0;
+            m_renderOptions->addTexture(file.baseName());
+            m_streamedTextures.insert(file.absoluteFilePath(), index);
+        } else if (m_textures[index] || m_texturesInFlight.contains(index) || m_evictedTextures.contains(index)) {
+            continue;
+        }
+        m_texturesInFlight.insert(index);
+        m_textureStreamer->request(index, file.absoluteFilePath(), size, size);
+    }
+}
+
+void Scene::textureStreamed(int index, GLTexture2D *texture)
+{
+    m_texturesInFlight.remove(index);
+    m_overTextureBudget = false;            // новая текстура, бюджет проверяется заново
+    if (m_options.mipmaps)
+        texture->setMipmapped(true);
+    delete m_textures[index];
+    m_textures[index] = texture;
+    if (index == m_currentTexture)
+        invalidateCubemaps();
+}
+
+void Scene::textureStreamFailed(int index)
+{
+    m_texturesInFlight.remove(index);       // остаётся заглушка
+}
+
+// Пока бюджет превышен, идём по текстурам от давно не использованных к
+// недавним: png текстуры, кроме текущей, выгружаются, кубы фона и отражений
+// уменьшаются вдвое. Текущую текстуру, шум и массив текстур не трогаем.
+void Scene::enforceTextureBudget()
+{
+    TextureResidency *residency = TextureResidency::instance();
+    if (!residency->isOverBudget()) {
+        m_overTextureBudget = false;
+        // выгруженный фон возвращается, только если влезает целиком, иначе его снова выгрузят
+        foreach (int size, m_suspendedLayers) {
+            if (residency->budget() <= 0 || residency->usedBytes() + qint64(size) * size * 4 * 6 <= residency->budget())
+                m_suspendedLayers.remove(size);
+        }
+        return;
+    }
+    if (m_overTextureBudget)
+        return;                                     // уже пробовали, ждём, пока что-нибудь освободится
+
+    const qint64 before = residency->usedBytes();
+    int evicted = 0, downsized = 0;
+    bool progress = true;
+    while (residency->isOverBudget() && progress) {
+        progress = false;
+        // после каждой перемены список берётся заново: вместе с текстурой могут уйти и другие из него
+        foreach (GLTexture *texture, residency->leastRecentlyBound()) {
+            if (evictTexture(texture)) {
+                ++evicted;
+                progress = true;
+                break;
+            }
+            if (downsizeTexture(texture)) {
+                ++downsized;
+                progress = true;
+                break;
+            }
+        }
+    }
+    if (evicted || downsized)
+        qDebug("Texture budget: evicted %d and downsized %d texture(s), %lld KB -> %lld KB",
+               evicted, downsized, before / 1024, residency->usedBytes() / 1024);
+    if (residency->isOverBudget()) {
+        m_overTextureBudget = true;
+        qWarning("Texture budget: %lld KB still in use, nothing left to evict within %lld KB.",
+                 residency->usedBytes() / 1024, residency->budget() / 1024);
+    }
+}
+
+bool Scene::evictTexture(GLTexture *texture)
+{
+    for (QHash<int, GLRenderTargetCube *>::iterator layer = m_environmentLayers.begin(); layer != m_environmentLayers.end(); ++layer) {
+        if (layer.value() == texture) {             // фон кубов пока рисуется в каждую грань
+            m_suspendedLayers.insert(layer.key());
+            delete layer.value();
+            m_environmentLayers.erase(layer);
+            return true;
+        }
+    }
+
+    const int index = m_textures.indexOf(texture);
+    if (index < 0 || index == m_currentTexture)
+        return false;
+    if (index >= m_textureFiles.size() && m_streamedTextures.key(index).isEmpty())
+        return false;                               // грузить потом неоткуда
+    delete texture;
+    m_textures[index] = 0;
+    m_evictedTextures.insert(index);
+    return true;
+}
+
+bool Scene::downsizeTexture(GLTexture *texture)
+{
+    if (texture == m_environment) {
+        if (m_environment->size() <= 128 || !GLRenderTargetCube::isCopySupported())
+            return false;
+        // уменьшаем на GPU из текущего куба, без повторного декодирования граней;
+        // сжатый куб (--texture-cache) так не прочитать, да и RGBA вдвое меньше не сэкономит
+        GLRenderTargetCube *environment = new GLRenderTargetCube(m_environment->size() / 2);
+        if (!environment->failed())
+            environment->setMipmapped(m_environment->isMipmapped());
+        if (environment->failed() || environment->byteCount() >= m_environment->byteCount()
+            || !environment->copyScaled(m_environment)) {
+            delete environment;                     // старый фон остаётся
+            return false;
+        }
+        delete m_environment;
+        m_environment = environment;
+        clearEnvironmentLayers();
+        invalidateCubemaps();
+        return true;
+    }
+
+    GLRenderTargetCube **cubemap = 0;
+    int probe = 0;                                  // 0 - центральный куб, i + 1 - куб кольца i
+    if (texture == m_mainCubemap)
+        cubemap = &m_mainCubemap;
+    for (int i = 0; i < m_cubemaps.size() && !cubemap; ++i) {
+        if (m_cubemaps[i] == texture) {
+            cubemap = &m_cubemaps[i];
+            probe = i + 1;
+        }
+    }
+    if (!cubemap || (*cubemap)->size() <= 64)
+        return false;
+    // верхний ярус - вдвое меньше текущего размера, нижний прежний
+    const int size = (*cubemap)->size() / 2;
+    GLRenderTargetCube *smaller = new GLRenderTargetCube(size, qMin(size, (*cubemap)->tierSize((*cubemap)->tierCount() - 1)));
+    smaller->setMipmapped((*cubemap)->isMipmapped());
+    delete *cubemap;
+    *cubemap = smaller;
+    m_cubemapScheduler->discard(probe);             // содержимое отрисуется заново, целиком
+    return true;
+}
+
+void Scene::reloadTexture(int index)
+{
+    const int size = qMin(256, m_maxTextureSize);
+    const QString fileName = index < m_textureFiles.size()
+        ? m_textureFiles.at(index).absoluteFilePath() : m_streamedTextures.key(index);
+    m_evictedTextures.remove(index);
+    m_texturesInFlight.insert(index);
+    m_textureStreamer->request(index, fileName, size, size);
 }
 
 void Scene::toggleDynamicCubemap(int state)
@@ -713,6 +1975,14 @@ void Scene::setColorParameter(const QString &name, QRgb color)
         program->setUniformValue(program->uniformLocation(name), QColor(color));
         program->release();
     }
+    foreach (QGLShaderProgram *program, m_layeredPrograms + m_probePrograms) {
+        if (!program)
+            continue;
+        program->bind();
+        program->setUniformValue(program->uniformLocation(name), QColor(color));
+        program->release();
+    }
+    invalidateCubemaps();
 }
 
 void Scene::setFloatParameter(const QString &name, float value)
@@ -723,6 +1993,14 @@ void Scene::setFloatParameter(const QString &name, float value)
         program->setUniformValue(program->uniformLocation(name), value);
         program->release();
     }
+    foreach (QGLShaderProgram *program, m_layeredPrograms + m_probePrograms) {
+        if (!program)
+            continue;
+        program->bind();
+        program->setUniformValue(program->uniformLocation(name), value);
+        program->release();
+    }
+    invalidateCubemaps();
 }
 
 void Scene::newItem(ItemDialog::ItemType type)
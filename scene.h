@@ -53,12 +53,71 @@ QT_BEGIN_NAMESPACE
 class QMatrix4x4;
 QT_END_NAMESPACE
 
+class NoiseVolume;
+class TaskGraph;
+class TextureStreamer;
+class TextureCacheFile;
+class CubemapScheduler;
+
+// Start-up settings of the scene, filled in from the command line in main.cpp.
+struct SceneOptions
+{
+    SceneOptions()
+        : noiseSize(128)
+        , noiseSeed(1)
+        , useCache(true)
+        , gpuNoise(false)
+        , verifyGpuNoise(false)
+        , progressive(false)
+        , mipmaps(false)
+        , benchmarkMinification(false)
+        , textureArray(false)
+        , textureCache(false)
+        , benchmarkTextureCache(false)
+        , textureBudget(0)
+        , layeredCubemaps(true)
+        , benchmarkCubemaps(false)
+        , offscreen(false)
+        , offscreenSamples(0)
+        , cubemapBudget(3.0f)
+        , cubemapTiers(true)
+        , cubemapEnvironmentLayer(true)
+        , probeMaterials(true)
+    {
+    }
+
+    int noiseSize;              // edge length of the 3D noise texture, a power of two
+    unsigned int noiseSeed;     // seed of the noise lattice
+    bool useCache;              // reuse generated resources from earlier runs
+    QString cacheDirectory;     // where they are kept, the standard cache location if empty
+    bool gpuNoise;              // render the noise volume on the GPU when possible
+    bool verifyGpuNoise;        // also generate it on the CPU and report the difference
+    bool progressive;           // draw with placeholders at once and load the rest in the background
+    QString startupTrace;       // print the startup timings and memory use, save the task trace to this file
+    QString textureDirectory;   // also load the .png files here, and new ones as they appear
+    bool mipmaps;               // give every texture and dynamic cube map a mip chain
+    bool benchmarkMinification; // once loaded, time the scene at the zoom levels in use with and without mipmaps
+    bool textureArray;          // keep the box textures in one array texture, the shaders pick the layer
+    bool textureCache;          // keep the box textures and the environment in the cache, block-compressed if possible
+    bool benchmarkTextureCache; // once loaded, time decoding the textures against mapping them from the cache
+    qint64 textureBudget;       // bytes of video memory for textures and render targets, 0 for no limit
+    bool layeredCubemaps;       // draw all six faces of a dynamic cube map in one pass where supported
+    bool benchmarkCubemaps;     // once loaded, time updating the dynamic cube maps face by face and in one pass
+    bool offscreen;             // render the main view into a texture and draw that into the window
+    int offscreenSamples;       // multisampling of the offscreen target, 0 for none
+    QString offscreenCapture;   // once loaded, save the offscreen view to this file
+    float cubemapBudget;        // milliseconds of GPU time per frame for updating dynamic cube maps, 0 for no limit
+    bool cubemapTiers;          // size dynamic cube maps by how large their boxes appear on screen
+    bool cubemapEnvironmentLayer;   // copy the environment into dynamic cube maps from a cached one instead of drawing it
+    bool probeMaterials;        // shade boxes in dynamic cube maps with the cheaper REFLECTION_PROBE variants, or flat
+};
+
 // УСТАНОВКА СЦЕНЫ, констуктор и инициализация объектов
 class Scene : public QGraphicsScene
 {
     Q_OBJECT
 public:
-    Scene(int width, int height, int maxTextureSize);
+    Scene(int width, int height, int maxTextureSize, const SceneOptions &options = SceneOptions());
     ~Scene();
     virtual void drawBackground(QPainter *painter, const QRectF &rect) Q_DECL_OVERRIDE;
 
@@ -69,12 +128,22 @@ public slots:
     void setColorParameter(const QString &name, QRgb color);        // установка цвета объетов, в параметрах - ??????
     void setFloatParameter(const QString &name, float value);       // установка цвета объетов, в параметрах - ??????
     void newItem(ItemDialog::ItemType type);                    // рисуем статические объекты
+private slots:
+    // подгрузка текстур во время работы, без задержки кадров
+    void textureDirectoryChanged(const QString &path);
+    void textureStreamed(int index, GLTexture2D *texture);
+    void textureStreamFailed(int index);
 protected:
-    void renderBoxes(const QMatrix4x4 &view, int excludeBox = -2);      // рисуем круг из боксов (??)
+    // рисуем круг из боксов (??); с 'projection' боксы вне пирамиды видимости пропускаются
+    void renderBoxes(const QMatrix4x4 &view, int excludeBox = -2, const QMatrix4x4 *projection = 0);
     void setStates();                                               //
     void setLights();                                               //
     void defaultStates();                                           //
     void renderCubemaps();                                          //
+    void renderCubemap(GLRenderTargetCube *target, const QVector3D &center, int excludeBox, int face = -1);  // один куб или одна грань
+    void invalidateCubemaps(bool ringOnly = false);                 // кубы, которые видят изменение
+    GLRenderTargetCube *environmentLayer(int size);                 // фон в кубе размера 'size', 0 без копирования граней
+    void clearEnvironmentLayers();                                  // фон изменился
 
     virtual void mousePressEvent(QGraphicsSceneMouseEvent *event) Q_DECL_OVERRIDE;      // работка с мышью, переопределяем функции обработки сообщений мыши (нажатие кнопок)
     virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) Q_DECL_OVERRIDE;    // переопределяем функции обработки сообщений мыши (отпускание кнопки)
@@ -94,6 +163,34 @@ protected:
     /// *** это моя вставка end
 private:
     void initGL();                                      // инициализация OpenGL
+    void buildStartupGraph();                           // граф задач старта, запускается ещё до создания панелей
+    void finishStartup();                               // отчёт о времени старта и трасса графа
+    void benchmarkMinification();                       // скорость отрисовки на дальних дистанциях с мипмапами и без
+    void benchmarkTextureCache();                       // загрузка текстур: декодирование против кэша
+    void benchmarkCubemaps();                           // обновление динамических кубов: по граням против одного прохода
+    QGLShaderProgram *linkLayeredProgram(QGLShader *fragmentShader);    // та же программа, но с геометрическим шейдером на шесть граней
+    QGLShaderProgram *boxProgram(int index) const;      // программа бокса для текущего прохода
+    void enforceTextureBudget();                        // выгрузка и уменьшение давно не использованных текстур
+    bool evictTexture(GLTexture *texture);              // png текстура выгружается, при выборе грузится снова; фон кубов - в грани, пока не влезет
+    bool downsizeTexture(GLTexture *texture);           // куб фона или отражений - вдвое меньше
+    void reloadTexture(int index);                      // выгруженная текстура снова через TextureStreamer
+    bool loadShader(const QFileInfo &file, const QByteArray &source);   // компиляция одного .fsh и добавление кубика с ним
+    // узлы графа старта: на рабочих потоках только CPU, всё с GL - на потоке контекста
+    void readParameters(int);                           // разбор .par файлов
+    void mapEnvironmentCache(int);                      // готовый куб фона из кэша, тогда грани не декодируются
+    void decodeEnvironmentFace(int face);               // декодирование и масштабирование грани фона
+    void uploadEnvironment(int);                        // GL: куб фона из шести граней
+    void decodeTexture(int index);                      // декодирование и масштабирование png
+    void uploadTexture(int index);                      // GL: текстура вместо заглушки
+    void readShaderSource(int index);                   // чтение .fsh
+    void linkShader(int index);                         // GL: компиляция и линковка, строго по порядку файлов
+    void prepareNoise(int);                             // каналы шума по исходникам шейдеров, кэш
+    void renderGpuNoise(int);                           // GL: объём шума на видеокарте
+    void beginNoiseUpload(int);                         // GL: текстура шума и кольцо буферов под слои
+    void generateNoiseSlab(int slab);                   // слой объёма шума, прямо в буфер кольца
+    void uploadNoiseSlab(int slab);                     // GL: слой в текстуру и в файл кэша, строго по порядку
+    QString cacheDirectory() const;                     // каталог кэша сгенерированных ресурсов
+    void drawOffscreenTarget();                         // готовый кадр из текстуры на окно
     QPointF pixelPosToViewPos(const QPointF& p);        // пересчёт координат экрана и сцены (ArcBall Rotation - http://pmg.org.ru/nehe/nehe48.htm)
 
     ///QTime m_time;    /// закоментируем лишнюю неиспользуемую переменную
@@ -102,6 +199,7 @@ private:
     int m_distExp;
     int m_frame;
     int m_maxTextureSize;
+    SceneOptions m_options;
 
     int m_currentShader;            // текущий шейдер (индекс шейдера)
     int m_currentTexture;           // текущая текстура (индекс текстуры)
@@ -123,6 +221,67 @@ private:
     GLTextureCube *m_environment;               // - фон - http://antongerdelan.net/opengl/cubemaps.html
     QGLShader *m_environmentShader;             //
     QGLShaderProgram *m_environmentProgram;     //
+
+    // все шесть граней динамического куба за один проход
+    bool m_layeredCubemaps;                     // поддерживается, и все программы слинковались
+    bool m_layeredPass;                         // renderBoxes() рисует в куб целиком
+    QGLShader *m_layeredVertexShader;           // basic.vsh без проекции
+    QGLShader *m_cubemapGeometryShader;         // cubemap.gsh, раздаёт треугольники по граням
+    QVector<QGLShaderProgram *> m_layeredPrograms;  // по программе на каждую из m_programs
+    QGLShaderProgram *m_layeredEnvironmentProgram;  //
+
+    // материалы в кубах отражений: вариант .fsh с REFLECTION_PROBE или плоская заливка
+    bool m_probePass;                           // renderBoxes() рисует в куб отражения
+    QGLShader *m_probeFallbackShader;           // освещённый цвет без текстур, для .fsh без варианта
+    QVector<QGLShader *> m_probeFragmentShaders;    // вариант REFLECTION_PROBE, 0 если его нет
+    QVector<QGLShaderProgram *> m_probePrograms;    // 0 - в кубы рисует сама программа из m_programs
+    QMatrix4x4 m_faceTransforms[6];             // проекция на грань, умноженная на её поворот
+    QMatrix4x4 m_cubemapProjection;             // проекция грани куба, 90°
+    int m_drawCalls;                            // счётчик для замеров
+    int m_culledDraws;                          // боксы, отброшенные отсечением по пирамиде видимости
+
+    // фон неподвижен и от положения не зависит: в кубы он копируется готовым, рисуются только боксы
+    enum BoxLayers {EnvironmentLayer = 1, BoxLayer = 2, AllLayers = EnvironmentLayer | BoxLayer};
+    int m_boxLayers;                            // что рисует renderBoxes()
+    QHash<int, GLRenderTargetCube *> m_environmentLayers;  // фон по размеру грани
+    QSet<int> m_suspendedLayers;                // размеры, чей фон выгружен ради бюджета: рисуется в каждую грань, пока не влезет
+
+    GLRenderTarget2D *m_offscreenTarget;        // --offscreen: главный вид рисуется сюда, размером с окно
+
+    CubemapScheduler *m_cubemapScheduler;       // какие динамические кубы перерисовать в этом кадре
+    QQuaternion m_cubemapRotations[2];          // повороты куба и кольца при прошлой проверке
+
+    // старт: граф задач, заглушки и промежуточные результаты узлов
+    TaskGraph *m_startup;                       // 0, когда всё загружено
+    QElapsedTimer m_startupTimer;               // время от создания сцены
+    int m_parametersTask;                       // узел разбора .par, его ждёт панель управления
+    int m_firstShaderTask;                      // узел линковки basic.fsh, без него не рисуем
+    GLTexture2D *m_placeholderTexture;          // текстура по умолчанию, пока нет настоящих
+    GLTexture2DArray *m_textureArray;           // --texture-array: все png слоями одной текстуры, иначе 0
+    QList<RenderParameter> m_parameters;        // параметры из .par файлов
+    QStringList m_environmentFiles;             // грани куба фона
+    QVector<QImage> m_environmentFaces;         //
+    QList<QFileInfo> m_textureFiles;            // png файлы
+    QVector<QImage> m_textureImages;            // декодированные, но ещё не загруженные в GL
+    QList<QFileInfo> m_shaderFiles;             // .fsh файлы
+    QVector<QByteArray> m_shaderSources;        //
+    NoiseVolume *m_loadingNoise;                // объём шума, который считается на рабочих потоках
+    GLTexture3D *m_loadingNoiseTexture;         // текстура, в которую идут его слои
+    QVector<GLPixelUnpackBuffer *> m_noiseRing; // буферы слоёв, слой i идёт через буфер i % размер
+    QVector<uchar *> m_noiseSlots;              // отображённая память этих буферов
+    int m_noiseSlabDepth;                       // срезов в слое
+    int m_noiseSlabCount;                       //
+    QSaveFile *m_noiseCacheFile;                // кэш, пишется по мере загрузки слоёв
+    TextureCacheFile *m_environmentCache;       // --texture-cache: куб фона в виде для GL, иначе 0
+    QVector<TextureCacheFile *> m_textureCaches;    // то же для png, по индексу файла
+
+    // текстуры из каталога --texture-dir
+    TextureStreamer *m_textureStreamer;         // декодирует на рабочих потоках, грузит в GL по чуть-чуть за кадр
+    QFileSystemWatcher *m_textureWatcher;       //
+    QHash<QString, int> m_streamedTextures;     // файл -> индекс в m_textures
+    QSet<int> m_texturesInFlight;               // запрошены, но ещё не пришли
+    QSet<int> m_evictedTextures;                // выгружены ради бюджета памяти
+    bool m_overTextureBudget;                   // уменьшать больше нечего, предупреждение уже было
 };
 
 #endif
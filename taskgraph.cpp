@@ -0,0 +1,416 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "taskgraph.h"
+
+#include <algorithm>
+
+//============================================================================//
+//                              WorkStealingPool                              //
+//============================================================================//
+
+class WorkStealingPool::Worker : public QThread
+{
+public:
+    Worker(WorkStealingPool *pool, int index) : m_pool(pool), m_index(index) {}
+
+    QMutex mutex;                   // guards 'tasks'
+    QList<QRunnable *> tasks;       // the owner works at the back, thieves at the front
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+private:
+    WorkStealingPool *m_pool;
+    int m_index;
+};
+
+void WorkStealingPool::Worker::run()
+{
+    while (QRunnable *runnable = m_pool->take(m_index)) {
+        bool autoDelete = runnable->autoDelete();
+        runnable->run();
+        if (autoDelete)
+            delete runnable;
+
+        if (!m_pool->m_active.deref() && m_pool->m_queued.load() <= 0) {
+            QMutexLocker locker(&m_pool->m_mutex);
+            m_pool->m_done.wakeAll();
+        }
+    }
+}
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : m_queued(0)
+    , m_active(0)
+    , m_next(0)
+    , m_stopping(false)
+{
+    for (int i = 0; i < qMax(threadCount, 1); ++i)
+        m_workers << new Worker(this, i);
+    foreach (Worker *worker, m_workers)
+        worker->start();
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    waitForDone();
+    m_mutex.lock();
+    m_stopping = true;
+    m_workAvailable.wakeAll();
+    m_mutex.unlock();
+    foreach (Worker *worker, m_workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+Q_GLOBAL_STATIC(WorkStealingPool, globalPool)
+
+WorkStealingPool *WorkStealingPool::globalInstance()
+{
+    return globalPool();
+}
+
+int WorkStealingPool::currentWorker() const
+{
+    QThread *thread = QThread::currentThread();
+    for (int i = 0; i < m_workers.size(); ++i) {
+        if (m_workers[i] == thread)
+            return i;
+    }
+    return -1;
+}
+
+void WorkStealingPool::start(QRunnable *runnable)
+{
+    int index = currentWorker();
+    if (index < 0)
+        index = quint32(m_next.fetchAndAddRelaxed(1)) % m_workers.size();
+
+    Worker *worker = m_workers[index];
+    worker->mutex.lock();
+    worker->tasks.append(runnable);
+    worker->mutex.unlock();
+    m_queued.ref();
+
+    // Taking the lock orders the wake-up after a worker that saw no work
+    // has gone to sleep.
+    QMutexLocker locker(&m_mutex);
+    m_workAvailable.wakeOne();
+}
+
+QRunnable *WorkStealingPool::take(int index)
+{
+    forever {
+        // Own deque first, newest task. Then the others, oldest task.
+        for (int i = 0; i < m_workers.size(); ++i) {
+            Worker *victim = m_workers[(index + i) % m_workers.size()];
+            QMutexLocker locker(&victim->mutex);
+            if (victim->tasks.isEmpty())
+                continue;
+            QRunnable *runnable = i == 0 ? victim->tasks.takeLast() : victim->tasks.takeFirst();
+            m_active.ref();
+            m_queued.deref();
+            return runnable;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        if (m_stopping)
+            return 0;
+        if (m_queued.load() <= 0)
+            m_workAvailable.wait(&m_mutex);
+    }
+}
+
+void WorkStealingPool::waitForDone()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_queued.load() > 0 || m_active.load() > 0)
+        m_done.wait(&m_mutex);
+}
+
+//============================================================================//
+//                                 TaskGraph                                  //
+//============================================================================//
+
+class TaskGraph::NodeTask : public QRunnable
+{
+public:
+    NodeTask(TaskGraph *graph, int id) : m_graph(graph), m_id(id) {}
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        m_graph->runNode(m_id, m_graph->m_pool->currentWorker());
+    }
+private:
+    TaskGraph *m_graph;
+    int m_id;
+};
+
+TaskGraph::TaskGraph(WorkStealingPool *pool)
+    : m_pool(pool)
+    , m_unfinished(0)
+    , m_running(0)
+    , m_started(false)
+    , m_cancelled(false)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cancelled = true;
+    while (m_running > 0)
+        m_changed.wait(&m_mutex);
+    locker.unlock();
+
+    for (int i = 0; i < m_nodes.size(); ++i)
+        delete m_nodes[i].task;
+}
+
+int TaskGraph::addTask(const QString &name, QRunnable *task, Affinity affinity, const QList<int> &dependencies)
+{
+    Q_ASSERT(!m_started);
+    Node node;
+    node.name = name;
+    node.task = task;
+    node.affinity = affinity;
+    node.dependencies = dependencies;
+    node.waitingFor = dependencies.size();
+    node.finished = false;
+    node.thread = -1;
+    node.startTime = node.endTime = 0;
+
+    int id = m_nodes.size();
+    foreach (int dependency, dependencies) {
+        Q_ASSERT(dependency >= 0 && dependency < id);
+        m_nodes[dependency].dependents << id;
+    }
+    m_nodes << node;
+    ++m_unfinished;
+    return id;
+}
+
+void TaskGraph::start()
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(!m_started);
+    m_started = true;
+    m_timer.start();
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].waitingFor == 0)
+            release(i);
+    }
+}
+
+void TaskGraph::release(int id)
+{
+    if (m_nodes[id].affinity == ContextThread) {
+        m_contextQueue.enqueue(id);
+        m_changed.wakeAll();
+    } else {
+        ++m_running;
+        m_pool->start(new NodeTask(this, id));
+    }
+}
+
+void TaskGraph::runNode(int id, int thread)
+{
+    m_mutex.lock();
+    bool cancelled = m_cancelled;
+    m_mutex.unlock();
+
+    // Only this thread touches the node's timing fields until it is finished.
+    Node &node = m_nodes[id];
+    if (!cancelled) {
+        node.thread = thread;
+        node.startTime = m_timer.nsecsElapsed();
+        node.task->run();
+        node.endTime = m_timer.nsecsElapsed();
+    }
+
+    QMutexLocker locker(&m_mutex);
+    node.finished = true;
+    --m_unfinished;
+    if (node.affinity == WorkerThread)
+        --m_running;
+    if (!m_cancelled) {
+        foreach (int dependent, node.dependents) {
+            if (--m_nodes[dependent].waitingFor == 0)
+                release(dependent);
+        }
+    }
+    m_changed.wakeAll();
+}
+
+int TaskGraph::runContextTasks(int budgetMs)
+{
+    QElapsedTimer budget;
+    budget.start();
+    int count = 0;
+    forever {
+        m_mutex.lock();
+        if (m_contextQueue.isEmpty() || (budgetMs >= 0 && count > 0 && budget.elapsed() >= budgetMs)) {
+            m_mutex.unlock();
+            break;
+        }
+        int id = m_contextQueue.dequeue();
+        m_mutex.unlock();
+
+        runNode(id, -1);
+        ++count;
+    }
+    return count;
+}
+
+void TaskGraph::wait(int task, bool runContext)
+{
+    forever {
+        if (runContext)
+            runContextTasks();
+        QMutexLocker locker(&m_mutex);
+        if (task < 0 ? m_unfinished == 0 : m_nodes[task].finished)
+            return;
+        if (!runContext || m_contextQueue.isEmpty())
+            m_changed.wait(&m_mutex);
+    }
+}
+
+bool TaskGraph::isFinished(int task) const
+{
+    QMutexLocker locker(&m_mutex);
+    return task < 0 ? m_unfinished == 0 : m_nodes[task].finished;
+}
+
+int TaskGraph::unfinishedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_unfinished;
+}
+
+// Walks back from the task that finished last, always through the dependency
+// that finished last, since that is the one the task was waiting for.
+QList<int> TaskGraph::criticalPath() const
+{
+    QList<int> path;
+    int last = -1;
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].finished && (last < 0 || m_nodes[i].endTime > m_nodes[last].endTime))
+            last = i;
+    }
+    while (last >= 0) {
+        path.prepend(last);
+        int previous = -1;
+        foreach (int dependency, m_nodes[last].dependencies) {
+            if (previous < 0 || m_nodes[dependency].endTime > m_nodes[previous].endTime)
+                previous = dependency;
+        }
+        last = previous;
+    }
+    return path;
+}
+
+static QString threadName(int thread)
+{
+    return thread < 0 ? QString("context") : QString("worker %1").arg(thread);
+}
+
+void TaskGraph::printTrace() const
+{
+    QMutexLocker locker(&m_mutex);
+    QList<QPair<qint64, int> > order;
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].finished)
+            order << qMakePair(m_nodes[i].startTime, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    qDebug("Task graph: %d tasks on %d worker threads", m_nodes.size(), m_pool->threadCount());
+    for (int i = 0; i < order.size(); ++i) {
+        const Node &node = m_nodes[order[i].second];
+        qDebug("  %8.2f - %8.2f ms  %-10s %s", node.startTime / 1e6, node.endTime / 1e6,
+               qPrintable(threadName(node.thread)), qPrintable(node.name));
+    }
+
+    QList<int> path = criticalPath();
+    QStringList names;
+    qint64 busy = 0;
+    foreach (int id, path) {
+        names << m_nodes[id].name;
+        busy += m_nodes[id].endTime - m_nodes[id].startTime;
+    }
+    if (!path.isEmpty()) {
+        qDebug("  critical path: %s", qPrintable(names.join(" -> ")));
+        qDebug("  critical path ends at %.2f ms, %.2f ms of it spent in its tasks",
+               m_nodes[path.last()].endTime / 1e6, busy / 1e6);
+    }
+}
+
+bool TaskGraph::writeTrace(const QString &fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("TaskGraph: Could not write trace to '%s'.", qPrintable(fileName));
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    QList<int> path = criticalPath();
+    QJsonArray events;
+    for (int i = 0; i < m_nodes.size(); ++i) {
+        const Node &node = m_nodes[i];
+        if (!node.finished)
+            continue;
+        QJsonObject event;
+        event["name"] = node.name;
+        event["cat"] = path.contains(i) ? QString("critical") : QString("task");
+        event["ph"] = QString("X");
+        event["ts"] = node.startTime / 1e3;
+        event["dur"] = (node.endTime - node.startTime) / 1e3;
+        event["pid"] = 1;
+        event["tid"] = node.thread + 1;
+        events.append(event);
+    }
+    for (int thread = -1; thread < m_pool->threadCount(); ++thread) {
+        QJsonObject event, args;
+        args["name"] = threadName(thread);
+        event["name"] = QString("thread_name");
+        event["ph"] = QString("M");
+        event["pid"] = 1;
+        event["tid"] = thread + 1;
+        event["args"] = args;
+        events.append(event);
+    }
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    file.write(QJsonDocument(trace).toJson());
+    return true;
+}
@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <QtCore>
+
+// A fixed set of worker threads, each with its own task deque. A worker
+// takes its newest task first, which keeps the data it just produced in
+// cache. A worker that runs out steals the oldest task from another worker,
+// so long chains on one thread do not leave the others idle. Tasks that
+// are started from outside the pool are dealt to the workers in turn.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int threadCount = QThread::idealThreadCount());
+    ~WorkStealingPool();
+
+    // The pool shared by the whole application.
+    static WorkStealingPool *globalInstance();
+
+    // Queues 'runnable'. It is deleted after running if autoDelete() is set.
+    void start(QRunnable *runnable);
+    // Blocks until every queued and running task has finished.
+    void waitForDone();
+    int threadCount() const {return m_workers.size();}
+    // Index of the calling worker thread, or -1 if it is not one of ours.
+    int currentWorker() const;
+
+private:
+    Q_DISABLE_COPY(WorkStealingPool)
+    class Worker;
+    friend class Worker;
+
+    QRunnable *take(int index);
+
+    QVector<Worker *> m_workers;
+    QMutex m_mutex;                 // only for sleeping and waking up, see take()
+    QWaitCondition m_workAvailable;
+    QWaitCondition m_done;
+    QAtomicInt m_queued;            // tasks in the deques, briefly off by one
+    QAtomicInt m_active;            // tasks running
+    QAtomicInt m_next;              // worker that gets the next task from outside
+    bool m_stopping;
+};
+
+// A dependency graph of named tasks. Worker tasks run on a WorkStealingPool
+// as soon as their dependencies have finished. Context tasks are for work
+// that must stay on one thread, such as OpenGL calls: they only run inside
+// runContextTasks() or wait(), one at a time, on the thread calling them.
+//
+// The start and end time and the thread of every task are recorded, so
+// that printTrace() can show where the time went and which chain of tasks
+// was the critical path. writeTrace() saves the same data in Chrome's trace
+// event format.
+class TaskGraph
+{
+public:
+    enum Affinity { WorkerThread, ContextThread };
+
+    explicit TaskGraph(WorkStealingPool *pool = WorkStealingPool::globalInstance());
+    // Waits for running worker tasks, tasks that have not started are dropped.
+    ~TaskGraph();
+
+    // Adds 'task' to run after all of 'dependencies' (ids returned by earlier
+    // calls) have finished. The graph takes ownership of 'task'. Tasks must
+    // be added before start().
+    int addTask(const QString &name, QRunnable *task, Affinity affinity = WorkerThread,
+                const QList<int> &dependencies = QList<int>());
+    void start();
+
+    // Runs ready context tasks on the calling thread. Stops when none are
+    // ready or, if 'budgetMs' is not negative, once that much time has passed
+    // (at least one task runs). Returns the number of tasks run.
+    int runContextTasks(int budgetMs = -1);
+    // Blocks until 'task', or all tasks if it is -1, has finished, running
+    // context tasks on the calling thread meanwhile. With 'runContext' false
+    // they are left queued, so 'task' must not depend on any of them.
+    void wait(int task = -1, bool runContext = true);
+
+    bool isFinished(int task = -1) const;
+    int taskCount() const {return m_nodes.size();}
+    int unfinishedCount() const;
+    qint64 elapsed() const {return m_timer.elapsed();}
+
+    void printTrace() const;
+    bool writeTrace(const QString &fileName) const;
+
+private:
+    Q_DISABLE_COPY(TaskGraph)
+    class NodeTask;
+    friend class NodeTask;
+
+    struct Node
+    {
+        QString name;
+        QRunnable *task;
+        Affinity affinity;
+        QList<int> dependencies;
+        QList<int> dependents;
+        int waitingFor;             // dependencies that have not finished yet
+        bool finished;
+        int thread;                 // worker index, or -1 for the context thread
+        qint64 startTime, endTime;  // nanoseconds since start()
+    };
+
+    void runNode(int id, int thread);
+    void release(int id);           // called with m_mutex held
+    QList<int> criticalPath() const;
+
+    WorkStealingPool *m_pool;
+    QVector<Node> m_nodes;
+    QQueue<int> m_contextQueue;
+    mutable QMutex m_mutex;
+    QWaitCondition m_changed;
+    QElapsedTimer m_timer;
+    int m_unfinished;
+    int m_running;                  // worker tasks handed to the pool and not finished
+    bool m_started;
+    bool m_cancelled;
+};
+
+#endif
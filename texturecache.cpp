@@ -0,0 +1,264 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "texturecache.h"
+
+#include <cstring>
+
+// Header of a texture cache file. The faces follow directly, in order.
+struct TextureCacheHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 format;
+    quint32 size;
+    quint32 faces;
+    quint32 sourceStamp;
+    quint32 faceBytes[6];
+};
+
+static const char TEXTURE_CACHE_MAGIC[4] = {'B', 'X', 'T', 'C'};
+
+TextureCacheFile::TextureCacheFile(const QString &name, const QStringList &sources, int size, bool compressed)
+    : m_name(name)
+    , m_sources(sources.mid(0, 6))
+    , m_size(size)
+    , m_compressed(compressed && compressionSupported())
+    , m_format(GL_BGRA)
+    , m_elapsed(0)
+{
+    for (int face = 0; face < 6; ++face) {
+        m_faces[face] = 0;
+        m_faceBytes[face] = 0;
+    }
+}
+
+bool TextureCacheFile::compressionSupported()
+{
+    return getGLExtensionFunctions().textureCompressionSupported();
+}
+
+QString TextureCacheFile::fileName(const QString &directory) const
+{
+    return QDir(directory).filePath(QString("texture-v%1-%2-%3x%4-%5.bin")
+        .arg(int(Version)).arg(m_name).arg(m_size).arg(faceCount()).arg(m_compressed ? "s3tc" : "bgra"));
+}
+
+// Changes whenever one of the sources is replaced.
+quint32 TextureCacheFile::sourceStamp() const
+{
+    QByteArray key;
+    foreach (const QString &source, m_sources) {
+        QFileInfo info(source);
+        key += source.toUtf8() + ' ' + QByteArray::number(info.size()) + ' '
+            + QByteArray::number(info.lastModified().toMSecsSinceEpoch()) + '\n';
+    }
+    return qHash(key);
+}
+
+bool TextureCacheFile::map(const QString &fileName)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_file.isOpen())
+        m_file.close();
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    TextureCacheHeader header;
+    bool ok = m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) == qint64(sizeof(header))
+        && memcmp(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == quint32(Version)
+        && header.size == quint32(m_size)
+        && header.faces == quint32(faceCount())
+        && header.sourceStamp == sourceStamp()
+        && (header.format != GL_BGRA) == m_compressed;
+    qint64 texelBytes = 0;
+    for (int face = 0; ok && face < faceCount(); ++face) {
+        ok = header.faceBytes[face] > 0;
+        texelBytes += header.faceBytes[face];
+    }
+    if (!ok || m_file.size() != qint64(sizeof(header)) + texelBytes) {
+        qWarning() << "TextureCacheFile::map: Ignoring stale or damaged cache file" << fileName;
+        m_file.close();
+        return false;
+    }
+
+    // The mapping stays valid until the file is closed.
+    const uchar *texels = m_file.map(sizeof(header), texelBytes);
+    if (!texels) {
+        m_file.close();
+        return false;
+    }
+    m_format = header.format;
+    for (int face = 0; face < faceCount(); ++face) {
+        m_faces[face] = texels;
+        m_faceBytes[face] = header.faceBytes[face];
+        texels += header.faceBytes[face];
+    }
+
+    m_elapsed = timer.elapsed();
+    return true;
+}
+
+qint64 TextureCacheFile::byteCount() const
+{
+    qint64 bytes = 0;
+    for (int face = 0; face < faceCount(); ++face)
+        bytes += m_faceBytes[face];
+    return bytes;
+}
+
+GLTexture2D *TextureCacheFile::createTexture2D() const
+{
+    if (!isMapped() || faceCount() != 1)
+        return 0;
+
+    // load() allocates on its own, loadCompressed() replaces any storage
+    GLTexture2D *texture = new GLTexture2D(m_size, m_size, false);
+    if (m_format == GL_BGRA)
+        texture->load(m_size, m_size, reinterpret_cast<const QRgb *>(m_faces[0]));
+    else
+        texture->loadCompressed(m_size, m_size, m_format, m_faces[0], m_faceBytes[0]);
+    return texture;
+}
+
+GLTextureCube *TextureCacheFile::createTextureCube() const
+{
+    if (!isMapped() || faceCount() != 6)
+        return 0;
+
+    GLTextureCube *texture = new GLTextureCube(m_size, false);
+    for (int face = 0; face < 6; ++face) {
+        if (m_format == GL_BGRA)
+            texture->load(m_size, face, reinterpret_cast<const QRgb *>(m_faces[face]));
+        else
+            texture->loadCompressed(m_size, face, m_format, m_faces[face], m_faceBytes[face]);
+    }
+    return texture;
+}
+
+GLTexture2D *TextureCacheFile::createTexture2D(const QImage &image, const QString &fileName) const
+{
+    GLTexture2D *texture = new GLTexture2D(m_size, m_size, false);
+    if (image.isNull())
+        return texture;
+
+    texture->load(m_size, m_size, reinterpret_cast<const QRgb *>(image.constBits()), uploadFormat(image));
+    GLenum format;
+    QList<QByteArray> images;
+    images << texture->imageData(&format);
+    save(fileName, images, format);
+    return texture;
+}
+
+GLTextureCube *TextureCacheFile::createTextureCube(const QVector<QImage> &faces, const QString &fileName) const
+{
+    GLTextureCube *texture = new GLTextureCube(m_size, false);
+    GLenum internalFormat = uploadFormat(QImage());
+    bool complete = faces.size() == 6;
+    foreach (const QImage &face, faces) {
+        complete &= !face.isNull();
+        if (!face.isNull() && uploadFormat(face) == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;     // one format for all faces
+    }
+    for (int face = 0; face < faces.size() && face < 6; ++face) {
+        if (!faces.at(face).isNull())
+            texture->load(m_size, face, reinterpret_cast<const QRgb *>(faces.at(face).constBits()), internalFormat);
+    }
+    if (!complete)
+        return texture;
+
+    GLenum format = GL_BGRA;
+    QList<QByteArray> images;
+    for (int face = 0; face < 6; ++face) {
+        GLenum faceFormat;
+        images << texture->imageData(face, &faceFormat);
+        if (face > 0 && faceFormat != format) {
+            qWarning() << "TextureCacheFile: Faces of" << m_name << "were stored in different formats, not caching them.";
+            return texture;
+        }
+        format = faceFormat;
+    }
+    save(fileName, images, format);
+    return texture;
+}
+
+// Internal format to upload 'image' with: DXT1 keeps only one bit of alpha,
+// so images that use alpha get DXT5.
+GLenum TextureCacheFile::uploadFormat(const QImage &image) const
+{
+    if (!m_compressed)
+        return 4;
+    for (int y = 0; y < image.height(); ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            if (qAlpha(line[x]) != 255)
+                return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        }
+    }
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+bool TextureCacheFile::save(const QString &fileName, const QList<QByteArray> &images, GLenum format) const
+{
+    if (m_compressed && format == GL_BGRA) {
+        // The file name promises compression, a BGRA file would never be mapped.
+        qWarning() << "TextureCacheFile::save: The driver did not compress" << m_name;
+        return false;
+    }
+
+    TextureCacheHeader header;
+    memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = Version;
+    header.format = format;
+    header.size = m_size;
+    header.faces = images.size();
+    header.sourceStamp = sourceStamp();
+    for (int face = 0; face < 6; ++face)
+        header.faceBytes[face] = face < images.size() ? images.at(face).size() : 0;
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile file(fileName);
+    bool ok = file.open(QIODevice::WriteOnly)
+        && file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+    foreach (const QByteArray &image, images)
+        ok = ok && file.write(image) == image.size();
+    if (!ok || !file.commit()) {
+        qWarning() << "TextureCacheFile::save: Failed to write" << fileName << file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "glbuffers.h"
+
+// A texture kept on disk in the form the GL takes without conversion, so
+// that later runs memory-map it and upload it with no image decode. The
+// images are S3TC block-compressed (DXT1 when fully opaque, DXT5 otherwise)
+// if the driver supports it and BGRA if not. The driver does the compression
+// on the first run, when the decoded images are uploaded; the result is read
+// back and written to the file.
+//
+// A file holds one 2D texture or the six faces of a cube map. It is keyed by
+// name, size, face count, compression and Version, which must be bumped
+// whenever the layout changes, and is ignored once a source image changes
+// size or modification time.
+class TextureCacheFile
+{
+public:
+    enum { Version = 1 };
+
+    // 'sources' holds one image for a 2D texture or six for a cube map, all
+    // scaled to size x size. Without compressionSupported() the file is BGRA
+    // whatever 'compressed' says.
+    TextureCacheFile(const QString &name, const QStringList &sources, int size, bool compressed = true);
+
+    // File name for this texture's key inside 'directory'.
+    QString fileName(const QString &directory) const;
+    // Maps the texture from 'fileName' if it holds one with the same key and
+    // the sources have not changed. Makes no OpenGL calls.
+    bool map(const QString &fileName);
+    bool isMapped() const {return m_file.isOpen();}
+
+    // Create the texture from the mapped file.
+    GLTexture2D *createTexture2D() const;
+    GLTextureCube *createTextureCube() const;
+    // Create the texture from decoded ARGB32 images, compressed by the driver
+    // if this file is, and write it to 'fileName'. Null images are left
+    // uninitialized and keep the file from being written.
+    GLTexture2D *createTexture2D(const QImage &image, const QString &fileName) const;
+    GLTextureCube *createTextureCube(const QVector<QImage> &faces, const QString &fileName) const;
+
+    const QString &name() const {return m_name;}
+    const QStringList &sources() const {return m_sources;}
+    int size() const {return m_size;}
+    int faceCount() const {return m_sources.size();}
+    bool isCompressed() const {return m_compressed;}
+    // Of the mapped file: GL_BGRA or the compressed format, and the texels.
+    GLenum format() const {return m_format;}
+    const uchar *data(int face) const {return m_faces[face];}
+    int byteCount(int face) const {return m_faceBytes[face];}
+    qint64 byteCount() const;
+    qint64 elapsed() const {return m_elapsed;} // map time in milliseconds
+
+    static bool compressionSupported();
+private:
+    GLenum uploadFormat(const QImage &image) const;
+    bool save(const QString &fileName, const QList<QByteArray> &images, GLenum format) const;
+    quint32 sourceStamp() const;
+
+    QString m_name;
+    QStringList m_sources;
+    int m_size;
+    bool m_compressed;
+    QFile m_file;
+    GLenum m_format;
+    const uchar *m_faces[6];
+    int m_faceBytes[6];
+    qint64 m_elapsed;
+};
+
+#endif
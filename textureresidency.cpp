@@ -0,0 +1,82 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "textureresidency.h"
+#include "glbuffers.h"
+
+#include <algorithm>
+
+TextureResidency::TextureResidency()
+    : m_budget(0)
+    , m_textureBytes(0)
+    , m_renderBufferBytes(0)
+    , m_peakBytes(0)
+    , m_clock(0)
+{
+}
+
+TextureResidency *TextureResidency::instance()
+{
+    static TextureResidency residency;
+    return &residency;
+}
+
+static bool boundEarlier(const GLTexture *a, const GLTexture *b)
+{
+    return a->lastBound() < b->lastBound();
+}
+
+QList<GLTexture *> TextureResidency::leastRecentlyBound() const
+{
+    QList<GLTexture *> textures = m_textures.toList();
+    std::sort(textures.begin(), textures.end(), boundEarlier);
+    return textures;
+}
+
+void TextureResidency::remove(GLTexture *texture, qint64 bytes)
+{
+    m_textures.remove(texture);
+    m_textureBytes -= bytes;
+}
+
+void TextureResidency::addTextureBytes(qint64 bytes)
+{
+    m_textureBytes += bytes;
+    m_peakBytes = qMax(m_peakBytes, usedBytes());
+}
+
+void TextureResidency::addRenderBufferBytes(qint64 bytes)
+{
+    m_renderBufferBytes += bytes;
+    m_peakBytes = qMax(m_peakBytes, usedBytes());
+}
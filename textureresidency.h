@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include <QtCore>
+
+class GLTexture;
+
+// Accounts the video memory of every GLTexture, mip levels included, and of
+// the depth buffers in GLDepthBufferPool, and keeps the order in which the
+// textures were last bound. It does not free anything itself: whoever owns
+// the textures checks isOverBudget() between frames and evicts or downsizes
+// them, least recently bound first, in whatever way they can be brought
+// back. All calls belong on the GL thread.
+class TextureResidency
+{
+public:
+    static TextureResidency *instance();
+
+    // 0 means no limit.
+    void setBudget(qint64 bytes) {m_budget = bytes;}
+    qint64 budget() const {return m_budget;}
+    bool isOverBudget() const {return m_budget > 0 && usedBytes() > m_budget;}
+
+    qint64 usedBytes() const {return m_textureBytes + m_renderBufferBytes;}
+    qint64 textureBytes() const {return m_textureBytes;}
+    qint64 renderBufferBytes() const {return m_renderBufferBytes;}
+    qint64 peakBytes() const {return m_peakBytes;}
+    int textureCount() const {return m_textures.size();}
+
+    // All live textures, least recently bound first.
+    QList<GLTexture *> leastRecentlyBound() const;
+    // Value of the bind clock: textures with GLTexture::lastBound() above
+    // the value taken at some point have been bound since.
+    quint64 clock() const {return m_clock;}
+
+private:
+    friend class GLTexture;
+    friend class GLDepthBufferPool;
+    friend class GLRenderTarget2D;
+
+    TextureResidency();
+    void add(GLTexture *texture) {m_textures.insert(texture);}
+    void remove(GLTexture *texture, qint64 bytes);
+    void addTextureBytes(qint64 bytes);
+    void addRenderBufferBytes(qint64 bytes);
+    quint64 tick() {return ++m_clock;}
+
+    QSet<GLTexture *> m_textures;
+    qint64 m_budget;
+    qint64 m_textureBytes;
+    qint64 m_renderBufferBytes;
+    qint64 m_peakBytes;
+    quint64 m_clock;
+
+    Q_DISABLE_COPY(TextureResidency)
+};
+
+#endif
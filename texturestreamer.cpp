@@ -0,0 +1,146 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "texturestreamer.h"
+#include "taskgraph.h"
+
+#include <cstring>
+
+class TextureStreamer::DecodeTask : public QRunnable
+{
+public:
+    DecodeTask(TextureStreamer *streamer, int id, const QString &fileName, int width, int height)
+        : m_streamer(streamer), m_id(id), m_fileName(fileName), m_width(width), m_height(height) {}
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        Decoded result;
+        result.id = m_id;
+        result.fileName = m_fileName;
+        result.image = QImage(m_fileName);
+        if (!result.image.isNull()) {
+            result.image = result.image.convertToFormat(QImage::Format_ARGB32);
+            if (result.image.width() != m_width || result.image.height() != m_height)
+                result.image = result.image.scaled(m_width, m_height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+        m_streamer->decoded(result);
+    }
+private:
+    TextureStreamer *m_streamer;
+    int m_id;
+    QString m_fileName;
+    int m_width, m_height;
+};
+
+TextureStreamer::TextureStreamer(int ringSize, QObject *parent)
+    : QObject(parent)
+    , m_decoding(0)
+    , m_ring(qMax(1, ringSize))
+    , m_nextBuffer(0)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_decoding > 0)
+        m_idle.wait(&m_mutex);
+    locker.unlock();
+    qDeleteAll(m_ring);
+}
+
+void TextureStreamer::request(int id, const QString &fileName, int width, int height)
+{
+    m_mutex.lock();
+    ++m_decoding;
+    m_mutex.unlock();
+    WorkStealingPool::globalInstance()->start(new DecodeTask(this, id, fileName, width, height));
+}
+
+void TextureStreamer::decoded(const Decoded &result)
+{
+    QMutexLocker locker(&m_mutex);
+    m_decoded.enqueue(result);
+    if (--m_decoding == 0)
+        m_idle.wakeAll();
+}
+
+int TextureStreamer::pendingCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_decoding + m_decoded.size();
+}
+
+int TextureStreamer::process(int budgetMs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    int count = 0;
+    forever {
+        m_mutex.lock();
+        if (m_decoded.isEmpty() || (count > 0 && timer.elapsed() >= budgetMs)) {
+            m_mutex.unlock();
+            break;
+        }
+        Decoded result = m_decoded.dequeue();
+        m_mutex.unlock();
+
+        if (result.image.isNull()) {
+            qWarning() << "TextureStreamer: Failed to load" << result.fileName;
+            emit textureFailed(result.id, result.fileName);
+            continue;
+        }
+
+        // Each buffer is refilled only every ringSize uploads, and lock()
+        // orphans its old storage, so the copy does not wait for the driver
+        // to finish reading the previous image from it.
+        const int bytes = result.image.byteCount();
+        GLPixelUnpackBuffer *&buffer = m_ring[m_nextBuffer];
+        m_nextBuffer = (m_nextBuffer + 1) % m_ring.size();
+        if (!buffer || buffer->size() < bytes) {
+            delete buffer;
+            buffer = new GLPixelUnpackBuffer(bytes);
+        }
+        memcpy(buffer->lock(), result.image.constBits(), bytes);
+        buffer->unlock();
+
+        const int width = result.image.width();
+        const int height = result.image.height();
+        GLTexture2D *texture = new GLTexture2D(width, height);
+        texture->load(width, height, static_cast<const QRgb *>(buffer->bind()));
+        buffer->unbind();
+
+        emit textureReady(result.id, texture);
+        ++count;
+    }
+    return count;
+}
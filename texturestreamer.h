@@ -0,0 +1,87 @@
+/****************************************************************************
+**
+** Copyright (C) 2015 The Qt Company Ltd.
+** Contact: http://www.qt.io/licensing/
+**
+** This file is part of the demonstration applications of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:LGPL21$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see http://www.qt.io/terms-conditions. For further
+** information use the contact form at http://www.qt.io/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 or version 3 as published by the Free
+** Software Foundation and appearing in the file LICENSE.LGPLv21 and
+** LICENSE.LGPLv3 included in the packaging of this file. Please review the
+** following information to ensure the GNU Lesser General Public License
+** requirements will be met: https://www.gnu.org/licenses/lgpl.html and
+** http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** As a special exception, The Qt Company gives you certain additional
+** rights. These rights are described in The Qt Company LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "glbuffers.h"
+
+// Loads 2D textures without stalling the GL thread. request() may be called
+// from any thread: the file is decoded, converted and scaled on the shared
+// WorkStealingPool. process(), called on the GL thread once per frame,
+// uploads the finished images through a ring of pixel unpack buffers for no
+// longer than its time budget, and emits textureReady() for each. Until then
+// the caller keeps drawing whatever placeholder it has.
+class TextureStreamer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TextureStreamer(int ringSize = 3, QObject *parent = 0);
+    // Waits for decodes still running. Needs the GL context to be current.
+    ~TextureStreamer();
+
+    // Queues 'fileName' to be loaded as a width x height texture. 'id' is
+    // handed back in the signals.
+    void request(int id, const QString &fileName, int width, int height);
+    // Uploads decoded images until none are left or 'budgetMs' has passed (at
+    // least one is uploaded). Call it on the GL thread. Returns the number of
+    // textures uploaded.
+    int process(int budgetMs = 2);
+    // Requests not yet decoded or not yet uploaded.
+    int pendingCount() const;
+signals:
+    // The receiver takes ownership of 'texture'.
+    void textureReady(int id, GLTexture2D *texture);
+    void textureFailed(int id, const QString &fileName);
+private:
+    class DecodeTask;
+    friend class DecodeTask;
+
+    struct Decoded
+    {
+        int id;
+        QString fileName;
+        QImage image;       // ARGB32, null if the file could not be read
+    };
+
+    void decoded(const Decoded &result);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_idle;
+    QQueue<Decoded> m_decoded;
+    int m_decoding;
+    QVector<GLPixelUnpackBuffer *> m_ring;  // grown to the largest image uploaded through each
+    int m_nextBuffer;
+};
+
+#endif